@@ -0,0 +1,121 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// Where the workers of a team run.
+enum class AffinityPolicy {
+    // Wherever the scheduler puts them.
+    None,
+    // Worker i on the i-th allowed CPU, filling one socket before the next.
+    Compact,
+    // Workers dealt round-robin over the sockets.
+    Scatter,
+    // Worker i on cpus[i % cpus.size()].
+    Explicit,
+};
+
+struct Affinity {
+    AffinityPolicy policy = AffinityPolicy::None;
+    // CPU ids of the Explicit policy.
+    std::vector<int> cpus;
+};
+
+// Part of the team name, empty for None.
+inline std::string affinityName(const Affinity &affinity) {
+    switch (affinity.policy) {
+        case AffinityPolicy::Compact:
+            return "Compact";
+        case AffinityPolicy::Scatter:
+            return "Scatter";
+        case AffinityPolicy::Explicit:
+            return "Pinned";
+        case AffinityPolicy::None:
+        default:
+            return "";
+    }
+}
+
+// Socket of a CPU from sysfs, 0 if it can't be read.
+inline int cpuPackage(int cpu) {
+    std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+    int package = 0;
+    if (!(file >> package))
+        return 0;
+    return package;
+}
+
+// CPUs this process may run on, grouped by socket.
+inline std::map<int, std::vector<int>> allowedCpusBySocket() {
+    std::map<int, std::vector<int>> sockets;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return sockets;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set))
+            sockets[cpuPackage(cpu)].push_back(cpu);
+    }
+    return sockets;
+}
+
+// CPU of each of the workers, empty for None. Workers wrap around when
+// there are more of them than CPUs.
+inline std::vector<int> workerCpus(const Affinity &affinity, uint32_t workers) {
+    if (affinity.policy == AffinityPolicy::None)
+        return {};
+
+    std::vector<int> order;
+    if (affinity.policy == AffinityPolicy::Explicit) {
+        order = affinity.cpus;
+    }
+    else {
+        std::map<int, std::vector<int>> sockets = allowedCpusBySocket();
+        if (affinity.policy == AffinityPolicy::Compact) {
+            for (auto &socket : sockets)
+                order.insert(order.end(), socket.second.begin(), socket.second.end());
+        }
+        else {
+            for (size_t k = 0; ; ++k) {
+                size_t before = order.size();
+                for (auto &socket : sockets) {
+                    if (k < socket.second.size())
+                        order.push_back(socket.second[k]);
+                }
+                if (order.size() == before)
+                    break;
+            }
+        }
+    }
+    if (order.empty())
+        return {};
+
+    std::vector<int> cpus(workers);
+    for (uint32_t i = 0; i < workers; ++i)
+        cpus[i] = order[i % order.size()];
+    return cpus;
+}
+
+inline bool pinThread(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+// Pins the calling process (a forked worker).
+inline bool pinProcess(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+#endif // AFFINITY_HPP
@@ -0,0 +1,74 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "lib/infint/InfInt.h"
+#include "lib/rtimers/cxx11.hpp"
+
+#include "generators.hpp"
+#include "collatz.hpp"
+
+// Counts heap allocations per Collatz step of the InfInt kernel, once with
+// the InfInt operators (what calcCollatz did originally) and once with the
+// in-place primitives used by calcCollatzInfInt.
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+static uint64_t calcCollatzOperators(InfInt n) {
+    uint64_t count = 0;
+    while (n != 1) {
+        ++count;
+        if (n % 2 == 1) {
+            n *= 3;
+            n += 1;
+        }
+        else {
+            n /= 2;
+        }
+    }
+    return count;
+}
+
+template <typename Kernel>
+static void measure(const std::string &name, Kernel kernel, const ContestInput &contest) {
+    rtimers::cxx11::DefaultTimer timer(name);
+    uint64_t steps = 0;
+    uint64_t before = allocations;
+    for (InfInt const & in : contest) {
+        auto scopedStartStop = timer.scopedStart();
+        steps += kernel(in);
+    }
+    uint64_t allocated = allocations - before;
+    std::cout << name << ": " << steps << " steps, " << allocated << " allocations, "
+              << (double) allocated / steps << " per step" << std::endl;
+}
+
+int main() {
+    ShortNumberContestGenerator shortGenerator;
+    LongNumberContestGenerator longGenerator;
+
+    for (ContestGenerator *generator : {(ContestGenerator *) &shortGenerator, (ContestGenerator *) &longGenerator}) {
+        ContestInput contest = generator->getContest(23);
+        std::string contestName = generator->getContestName(23);
+        measure("InfIntOperators" + contestName, calcCollatzOperators, contest);
+        measure("InfIntInPlace" + contestName, calcCollatzInfInt, contest);
+    }
+
+    return 0;
+}
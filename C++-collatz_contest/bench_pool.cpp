@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lib/pool/cxxpool.h"
+#include "lib/rtimers/cxx11.hpp"
+
+// Throughput of cxxpool::thread_pool on 1M empty tasks, with the global
+// queue and with per-worker queues, for 1..N threads:
+//  - push:   every task pushed separately from the main thread,
+//  - bulk:   all tasks pushed with one parallel_for of grain 1,
+//  - nested: one task per thread, each pushing its share of the tasks from
+//            inside the pool (where per-worker queues keep them local).
+
+static const size_t TASKS = 1000000;
+
+static double benchPush(cxxpool::thread_pool &pool) {
+    std::vector<std::future<void>> futures;
+    futures.reserve(TASKS);
+    auto start = rtimers::cxx11::HiResClock::now();
+    for (size_t i = 0; i < TASKS; ++i)
+        futures.push_back(pool.push([] {}));
+    cxxpool::get(futures.begin(), futures.end());
+    return rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+}
+
+static double benchBulk(cxxpool::thread_pool &pool) {
+    auto start = rtimers::cxx11::HiResClock::now();
+    pool.parallel_for((size_t) 0, TASKS, (size_t) 1, [](size_t) {}).get();
+    return rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+}
+
+static double benchNested(cxxpool::thread_pool &pool, size_t threads) {
+    std::atomic<size_t> done{0};
+    auto start = rtimers::cxx11::HiResClock::now();
+    pool.parallel_for((size_t) 0, threads, (size_t) 1, [&](size_t) {
+        for (size_t i = 0; i < TASKS / threads; ++i)
+            pool.push([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    }).get();
+    while (done.load(std::memory_order_relaxed) < TASKS / threads * threads)
+        std::this_thread::yield();
+    return rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+}
+
+static void report(const std::string &name, double seconds) {
+    std::cout << "  " << name << ": " << seconds << "s, " << (size_t) (TASKS / seconds) << " tasks/s" << std::endl;
+}
+
+int main() {
+    size_t maxThreads = std::max(4u, std::thread::hardware_concurrency());
+
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        for (cxxpool::queue_mode mode : {cxxpool::queue_mode::global, cxxpool::queue_mode::work_stealing}) {
+            std::cout << (mode == cxxpool::queue_mode::global ? "global" : "work_stealing")
+                      << " <" << threads << ">" << std::endl;
+            cxxpool::thread_pool pool(threads, mode);
+            report("push", benchPush(pool));
+            report("bulk", benchBulk(pool));
+            report("nested", benchNested(pool, threads));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+
+#include "lib/infint/InfInt.h"
+#include "lib/rtimers/cxx11.hpp"
+
+#include "generators.hpp"
+#include "teams.hpp"
+#include "collatzmemo.hpp"
+
+// Long run against a bounded cache: a skewed stream of big inputs, of which
+// a small hot set repeats, so the hit rate shows how well a policy keeps it.
+static void benchEviction(EvictionKind kind) {
+    const int LOOKUPS = 200000;
+    const uint64_t HOT_KEYS = 2000;
+    const uint64_t COLD_KEYS = 1 << 20;
+
+    CacheLimits limits;
+    limits.maxEntries = 4096;
+    limits.maxBytes = 1 << 20;
+    limits.eviction = kind;
+    SharedResults shared{MemoPolicy{}, SharedResults::DEFAULT_DENSE_LIMIT, limits};
+
+    const InfInt base = InfInt("1267650600228229401496703205376"); // 2^100
+    uint64_t random = 88172645463325252ULL;
+    rtimers::cxx11::DefaultTimer timer("Eviction<" + makeEvictionPolicy(kind)->getName() + ">");
+    {
+        auto scopedStartStop = timer.scopedStart();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            InfInt in = base + InfInt((unsigned long long) (random % 4 != 0 ? random % HOT_KEYS : HOT_KEYS + random % COLD_KEYS));
+            if (!shared.tryRead(in).first)
+                shared.assignComputed(in, calcCollatzShared(in, shared));
+        }
+    }
+
+    CacheStats stats = shared.getCacheStats();
+    std::cout << "  hit rate " << stats.hitRate() << ", " << stats.entries << " entries, " << stats.bytes
+              << " bytes, " << stats.evictions << " evictions, " << stats.rejected << " rejected" << std::endl;
+}
+
+// Contention benchmark of SharedResults: TeamConstThreadsX with 1..64
+// threads on contests where most lookups hit the same few keys
+// (SameNumber) or spread over many keys (ShortNumber).
+int main() {
+    const int REPETITIONS = 5;
+
+    SameNumberContestGenerator sameGenerator;
+    ShortNumberContestGenerator shortGenerator;
+
+    for (ContestGenerator *generator : {(ContestGenerator *) &sameGenerator, (ContestGenerator *) &shortGenerator}) {
+        ContestInput contest = generator->getContest(23);
+        for (uint32_t numWorkers : {1, 2, 4, 8, 16, 32, 64}) {
+            TeamConstThreads team{numWorkers, true};
+            rtimers::cxx11::DefaultTimer timer(team.getTeamName() + generator->getContestName(23));
+            for (int i = 0; i < REPETITIONS; ++i) {
+                auto scopedStartStop = timer.scopedStart();
+                team.runContest(contest);
+            }
+        }
+    }
+
+    for (EvictionKind kind : {EvictionKind::Clock, EvictionKind::SampledLfu})
+        benchEviction(kind);
+
+    return 0;
+}
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "lib/rtimers/cxx11.hpp"
+
+#include "generators.hpp"
+#include "teamfactory.hpp"
+
+// Benchmark driver for the teams, meant to be run per commit to catch
+// scaling regressions. Every selected team runs every selected contest
+// --warmup times unmeasured and --reps times measured. It reports the
+// median, p95 and p99 of the times, and the speedup and efficiency
+// (speedup / workers) of the median against TeamSolo on the same contest,
+// where workers counts every thread or process the team computes on.
+// Results are checked against TeamSolo's.
+//
+// Usage: bench_teams [options]
+//   --teams <names>       inner team names (teamfactory.hpp), default all
+//   --generators <names>  SameNumber, ShortNumber, LongNumber, default all
+//   --contests <ids>      default 2,5,23
+//   --workers <counts>    default 1,2,4
+//   --share <mode>        plain, x or both (default)
+//   --warmup <n>          default 1
+//   --reps <n>            default 5
+//   --label <text>        copied to every row, e.g. the commit hash
+//   --csv <path>          CSV output, - for stdout (the default)
+//   --json <path>         JSON output, - for stdout
+// Lists are comma-separated. The rtimers reports of the teams go to stderr,
+// so that stdout carries only the results.
+
+// getGeneratorName of the generators in generators.hpp.
+static const std::vector<std::string> GENERATOR_NAMES = {"SameNumber", "ShortNumber", "LongNumber"};
+
+struct Options {
+    std::vector<std::string> teams;
+    std::vector<std::string> generators = GENERATOR_NAMES;
+    std::vector<uint32_t> contests = {2, 5, 23};
+    std::vector<uint32_t> workers = {1, 2, 4};
+    std::vector<bool> shares = {false, true};
+    uint32_t warmup = 1;
+    uint32_t reps = 5;
+    std::string label;
+    std::string csvPath;
+    std::string jsonPath;
+};
+
+struct Row {
+    std::string team;
+    std::string generator;
+    uint32_t contest;
+    uint32_t workers;
+    std::vector<double> seconds;
+    double median;
+    double p95;
+    double p99;
+    double speedup;
+    double efficiency;
+};
+
+static std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static std::vector<uint32_t> splitNumbers(const std::string &list) {
+    std::vector<uint32_t> numbers;
+    for (const std::string &item : splitList(list))
+        numbers.push_back(strtoul(item.c_str(), NULL, 10));
+    return numbers;
+}
+
+static bool contains(const std::vector<std::string> &list, const std::string &item) {
+    return std::find(list.begin(), list.end(), item) != list.end();
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double> &sorted, double p) {
+    size_t rank = (size_t) std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::max(rank, (size_t) 1) - 1];
+}
+
+static void usage(const char *name) {
+    std::cerr << "usage: " << name << " [--teams <names>] [--generators <names>] [--contests <ids>]"
+              << " [--workers <counts>] [--share plain|x|both] [--warmup <n>] [--reps <n>]"
+              << " [--label <text>] [--csv <path>] [--json <path>]\nteams:";
+    for (auto &maker : teamMakers())
+        std::cerr << " " << maker.first;
+    std::cerr << "\ngenerators:";
+    for (const std::string &generator : GENERATOR_NAMES)
+        std::cerr << " " << generator;
+    std::cerr << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc)
+            return false;
+        std::string value = argv[++i];
+        if (arg == "--teams") {
+            options.teams = splitList(value);
+        }
+        else if (arg == "--generators") {
+            options.generators = splitList(value);
+        }
+        else if (arg == "--contests") {
+            options.contests = splitNumbers(value);
+        }
+        else if (arg == "--workers") {
+            options.workers = splitNumbers(value);
+            if (std::count(options.workers.begin(), options.workers.end(), 0u) > 0)
+                return false;
+        }
+        else if (arg == "--share") {
+            if (value == "plain")
+                options.shares = {false};
+            else if (value == "x")
+                options.shares = {true};
+            else if (value == "both")
+                options.shares = {false, true};
+            else
+                return false;
+        }
+        else if (arg == "--warmup") {
+            options.warmup = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg == "--reps") {
+            options.reps = strtoul(value.c_str(), NULL, 10);
+            if (options.reps == 0)
+                return false;
+        }
+        else if (arg == "--label") {
+            options.label = value;
+        }
+        else if (arg == "--csv") {
+            options.csvPath = value;
+        }
+        else if (arg == "--json") {
+            options.jsonPath = value;
+        }
+        else {
+            return false;
+        }
+    }
+    for (const std::string &team : options.teams) {
+        bool known = false;
+        for (auto &maker : teamMakers())
+            known = known || maker.first == team;
+        if (!known)
+            return false;
+    }
+    for (const std::string &generator : options.generators) {
+        if (!contains(GENERATOR_NAMES, generator))
+            return false;
+    }
+    if (options.csvPath.empty() && options.jsonPath.empty())
+        options.csvPath = "-";
+    return true;
+}
+
+// Times of reps runs of contest after warmup ones. Exits if a result
+// differs from expected (unless expected is empty).
+static std::vector<double> measure(Team &team, const ContestInput &contest, const ContestResult &expected,
+                                   const Options &options) {
+    std::vector<double> seconds;
+    for (uint32_t i = 0; i < options.warmup + options.reps; ++i) {
+        auto start = rtimers::cxx11::HiResClock::now();
+        ContestResult result = team.runContest(contest);
+        double elapsed = rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+        if (!expected.empty() && result != expected) {
+            std::cerr << team.getTeamName() << ": wrong result" << std::endl;
+            exit(1);
+        }
+        if (i >= options.warmup)
+            seconds.push_back(elapsed);
+    }
+    return seconds;
+}
+
+static Row makeRow(Team &team, ContestGenerator &generator, uint32_t contestId, std::vector<double> seconds,
+                   double soloMedian) {
+    Row row;
+    row.team = team.getTeamName();
+    row.generator = generator.getGeneratorName();
+    row.contest = contestId;
+    row.workers = team.getWorkerCount();
+    row.seconds = seconds;
+    std::sort(seconds.begin(), seconds.end());
+    row.median = seconds.size() % 2 == 1 ? seconds[seconds.size() / 2]
+                                         : (seconds[seconds.size() / 2 - 1] + seconds[seconds.size() / 2]) / 2;
+    row.p95 = percentile(seconds, 95);
+    row.p99 = percentile(seconds, 99);
+    row.speedup = soloMedian / row.median;
+    row.efficiency = row.speedup / row.workers;
+    return row;
+}
+
+// Labels, names and generators never hold quotes or commas in practice;
+// quote them in CSV and escape them in JSON anyway.
+static std::string csvField(const std::string &text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string jsonString(const std::string &text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeCsv(std::ostream &out, const std::vector<Row> &rows, const Options &options) {
+    out << "label,team,generator,contest,workers,reps,median_s,p95_s,p99_s,min_s,max_s,speedup,efficiency\n";
+    for (const Row &row : rows) {
+        out << csvField(options.label) << "," << csvField(row.team) << "," << csvField(row.generator) << ","
+            << row.contest << "," << row.workers << "," << row.seconds.size() << ","
+            << row.median << "," << row.p95 << "," << row.p99 << ","
+            << *std::min_element(row.seconds.begin(), row.seconds.end()) << ","
+            << *std::max_element(row.seconds.begin(), row.seconds.end()) << ","
+            << row.speedup << "," << row.efficiency << "\n";
+    }
+}
+
+static void writeJson(std::ostream &out, const std::vector<Row> &rows, const Options &options) {
+    out << "{\n  \"label\": " << jsonString(options.label) << ",\n"
+        << "  \"warmup\": " << options.warmup << ",\n  \"results\": [";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row &row = rows[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"team\": " << jsonString(row.team) << ", \"generator\": " << jsonString(row.generator)
+            << ", \"contest\": " << row.contest << ", \"workers\": " << row.workers
+            << ", \"median_s\": " << row.median << ", \"p95_s\": " << row.p95 << ", \"p99_s\": " << row.p99
+            << ", \"speedup\": " << row.speedup << ", \"efficiency\": " << row.efficiency << ", \"seconds\": [";
+        for (size_t j = 0; j < row.seconds.size(); ++j)
+            out << (j == 0 ? "" : ", ") << row.seconds[j];
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// To path, or to stdout (saved in stdoutFd) for -.
+static bool writeOutput(const std::string &path, int stdoutFd, const std::vector<Row> &rows,
+                        const Options &options, bool json) {
+    if (path.empty())
+        return true;
+    std::ostringstream text;
+    text.precision(9);
+    if (json)
+        writeJson(text, rows, options);
+    else
+        writeCsv(text, rows, options);
+
+    if (path == "-") {
+        std::string bytes = text.str();
+        size_t done = 0;
+        while (done < bytes.size()) {
+            ssize_t n = write(stdoutFd, bytes.data() + done, bytes.size() - done);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                std::cerr << "can't write to stdout" << std::endl;
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    }
+
+    std::ofstream out(path);
+    out << text.str();
+    out.flush();
+    if (!out) {
+        std::cerr << "can't write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The rtimers reports go to std::cout, keep them out of the results.
+    int stdoutFd = dup(STDOUT_FILENO);
+    if (stdoutFd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+        std::cerr << "dup - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<std::shared_ptr<ContestGenerator>> generators;
+    for (std::shared_ptr<ContestGenerator> generator : {
+            std::shared_ptr<ContestGenerator>(new SameNumberContestGenerator{}),
+            std::shared_ptr<ContestGenerator>(new ShortNumberContestGenerator{}),
+            std::shared_ptr<ContestGenerator>(new LongNumberContestGenerator{})}) {
+        if (contains(options.generators, generator->getGeneratorName()))
+            generators.push_back(generator);
+    }
+
+    // The baseline of every contest: inputs, results and TeamSolo's median.
+    struct Contest {
+        ContestGenerator *generator;
+        uint32_t id;
+        ContestInput input;
+        ContestResult expected;
+        double soloMedian;
+    };
+    std::vector<Contest> contests;
+    std::vector<Row> rows;
+    TeamSolo solo{1};
+    for (auto &generator : generators) {
+        for (uint32_t contestId : options.contests) {
+            Contest contest{generator.get(), contestId, generator->getContest(contestId), {}, 0.0};
+            contest.expected = solo.runContest(contest.input);
+            Row row = makeRow(solo, *generator, contestId, measure(solo, contest.input, {}, options), 0.0);
+            contest.soloMedian = row.median;
+            row.speedup = 1.0;
+            row.efficiency = 1.0;
+            if (options.teams.empty() || contains(options.teams, "TeamSolo"))
+                rows.push_back(row);
+            contests.push_back(std::move(contest));
+        }
+    }
+
+    // One team at a time, so only its workers exist while it is measured.
+    std::vector<std::string> measured = {solo.getTeamName()};
+    for (auto &maker : teamMakers()) {
+        if (maker.first == "TeamSolo" || (!options.teams.empty() && !contains(options.teams, maker.first)))
+            continue;
+        for (bool share : options.shares) {
+            for (uint32_t workers : options.workers) {
+                std::shared_ptr<Team> team = maker.second(workers, share);
+                // Teams ignoring their size come out the same for every count.
+                if (contains(measured, team->getTeamName()))
+                    continue;
+                measured.push_back(team->getTeamName());
+                for (Contest &contest : contests) {
+                    rows.push_back(makeRow(*team, *contest.generator, contest.id,
+                                           measure(*team, contest.input, contest.expected, options),
+                                           contest.soloMedian));
+                }
+            }
+        }
+    }
+
+    bool written = writeOutput(options.csvPath, stdoutFd, rows, options, false);
+    written = writeOutput(options.jsonPath, stdoutFd, rows, options, true) && written;
+    close(stdoutFd);
+    return written ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#ifndef BIGUINT_HPP
+#define BIGUINT_HPP
+
+#include <assert.h>
+#include <cstdint>
+#include <vector>
+
+#include "lib/infint/InfInt.h"
+
+typedef unsigned __int128 uint128_t;
+
+// Non-negative big integer stored in 64-bit binary limbs (little-endian).
+// Unlike InfInt (base 10^9) parity is a bit test and halving is a shift,
+// which is all the Collatz kernel needs.
+class BigUInt {
+public:
+    BigUInt(): limbs(1, 0) {}
+
+    explicit BigUInt(uint128_t x): limbs{(uint64_t) x, (uint64_t) (x >> 64)} {
+        trim();
+    }
+
+    explicit BigUInt(const InfInt &n): limbs(1, 0) {
+        assert(n >= 0);
+        // Limbs are base 10^9, least significant first.
+        const ELEM_TYPE *digits = n.limbData();
+        limbs.reserve(n.limbCount() * 30 / 64 + 1);
+        for (size_t i = n.limbCount(); i-- > 0;)
+            mulSmallAdd(BASE, (uint32_t) digits[i]);
+    }
+
+    bool isOdd() const { return limbs[0] & 1; }
+    bool isOne() const { return limbs.size() == 1 && limbs[0] == 1; }
+    bool fitsUint128() const { return limbs.size() <= 2; }
+    size_t limbCount() const { return limbs.size(); }
+    uint64_t lowLimb() const { return limbs[0]; }
+    size_t bitLength() const { return limbs.size() * 64 - (limbs.back() != 0 ? __builtin_clzll(limbs.back()) : 64); }
+
+    uint128_t toUint128() const {
+        assert(fitsUint128());
+        return limbs.size() == 1 ? limbs[0] : ((uint128_t) limbs[1] << 64) | limbs[0];
+    }
+
+    // this = this * mul + add
+    void mulSmallAdd(uint64_t mul, uint64_t add) {
+        uint64_t carry = add;
+        for (uint64_t &limb : limbs) {
+            uint128_t product = (uint128_t) limb * mul + carry;
+            limb = (uint64_t) product;
+            carry = (uint64_t) (product >> 64);
+        }
+        if (carry != 0)
+            limbs.push_back(carry);
+        trim();
+    }
+
+    void shiftRight(size_t bits) {
+        size_t limbShift = bits / 64;
+        unsigned bitShift = bits % 64;
+        if (limbShift >= limbs.size()) {
+            limbs.assign(1, 0);
+            return;
+        }
+
+        size_t newSize = limbs.size() - limbShift;
+        for (size_t i = 0; i < newSize; ++i) {
+            uint64_t limb = limbs[i + limbShift] >> bitShift;
+            if (bitShift != 0 && i + 1 < newSize)
+                limb |= limbs[i + limbShift + 1] << (64 - bitShift);
+            limbs[i] = limb;
+        }
+        limbs.resize(newSize);
+        trim();
+    }
+
+    // Number of trailing zero bits, the value must not be zero.
+    size_t trailingZeros() const {
+        size_t i = 0;
+        while (limbs[i] == 0)
+            ++i;
+        return i * 64 + __builtin_ctzll(limbs[i]);
+    }
+
+    // Divides by the largest power of two dividing the value, returns its exponent.
+    size_t stripTrailingZeros() {
+        size_t zeros = trailingZeros();
+        if (zeros != 0)
+            shiftRight(zeros);
+        return zeros;
+    }
+
+private:
+    void trim() {
+        while (limbs.size() > 1 && limbs.back() == 0)
+            limbs.pop_back();
+    }
+
+    std::vector<uint64_t> limbs;
+};
+
+#endif // BIGUINT_HPP
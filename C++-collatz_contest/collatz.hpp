@@ -2,28 +2,207 @@
 #define COLLATZ_HPP
 
 #include <assert.h>
+#include <cstdint>
+
+#include "lib/infint/InfInt.h"
+
+#include "biguint.hpp"
+#include "jumptable.hpp"
 
 #define SHM_NAME_IN "/collatz_mem_in"
 #define SHM_NAME_OUT "/collatz_mem_out"
-#define MAX_INFINT_LEN 100
 
-inline uint64_t calcCollatz(InfInt n) {
+// Every number with at most that many decimal digits fits in the native type.
+#define UINT64_SAFE_DIGITS 19
+#define UINT128_SAFE_DIGITS 38
+// Same for InfInt limbs (9 digits each).
+#define UINT128_SAFE_LIMBS 4
+
+// Largest odd values for which 3n + 1 still fits in the native type.
+static const uint64_t UINT64_ODD_LIMIT = (UINT64_MAX - 1) / 3;
+static const uint128_t UINT128_ODD_LIMIT = (~(uint128_t) 0 - 1) / 3;
+
+// Reference kernel, every step is done in place on InfInt.
+inline uint64_t calcCollatzInfInt(InfInt n) {
+    static const InfInt one = 1;
     // It's ok even if the value overflow
     uint64_t count = 0;
     assert(n > 0);
 
-    while (n != 1) {
+    while (n != one) {
         ++count;
-        if (n % 2 == 1) {
-            n *= 3;
-            n += 1;
-        }
-        else {
-            n /= 2;
-        }            
+        if (n.isOdd())
+            n.mulSmallAdd(3, 1);
+        else
+            n.divSmall(2);
     }
 
     return count;
 }
 
-#endif // COLLATZ_HPP
\ No newline at end of file
+// Value of count InfInt limbs (base 10^9, least significant first), which
+// have to fit in uint128_t.
+inline uint128_t limbsToUint128(const ELEM_TYPE *limbs, size_t count) {
+    uint128_t x = 0;
+    for (size_t i = count; i-- > 0;)
+        x = x * BASE + (uint32_t) limbs[i];
+    return x;
+}
+
+inline uint128_t infIntToUint128(const InfInt &n) {
+    assert(n.numberOfDigits() <= UINT128_SAFE_DIGITS);
+    return limbsToUint128(n.limbData(), n.limbCount());
+}
+
+inline int ctz128(uint128_t x) {
+    uint64_t low = (uint64_t) x;
+    return low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (x >> 64));
+}
+
+// Plain kernel steps, one Collatz step (or one run of halvings) at a time.
+struct ScalarSteps {
+    // Runs the trajectory on uint64_t until it reaches 1 (returns true)
+    // or until 3x + 1 would overflow (returns false, x is left odd).
+    static bool steps64(uint64_t &x, uint64_t &count) {
+        while (x != 1) {
+            if (x & 1) {
+                if (x > UINT64_ODD_LIMIT)
+                    return false;
+                x = 3 * x + 1;
+                ++count;
+            }
+            int zeros = __builtin_ctzll(x);
+            x >>= zeros;
+            count += zeros;
+        }
+        return true;
+    }
+
+    // Runs the trajectory on uint128_t while x does not fit in uint64_t.
+    // Returns false (x is left odd) if 3x + 1 would overflow.
+    static bool steps128(uint128_t &x, uint64_t &count) {
+        while (x > UINT64_MAX) {
+            if (x & 1) {
+                if (x > UINT128_ODD_LIMIT)
+                    return false;
+                x = 3 * x + 1;
+                ++count;
+            }
+            int zeros = ctz128(x);
+            x >>= zeros;
+            count += zeros;
+        }
+        return true;
+    }
+
+    // Runs the trajectory on BigUInt until x fits in uint128_t again.
+    static void stepsBig(BigUInt &n, uint64_t &count) {
+        while (!n.fitsUint128()) {
+            if (n.isOdd()) {
+                n.mulSmallAdd(3, 1);
+                ++count;
+            }
+            count += n.stripTrailingZeros();
+        }
+    }
+};
+
+// Kernel steps advancing K shortcut steps at once with CollatzJumpTable<K>,
+// same contracts as ScalarSteps. Jumps are taken while x >= 2^K and the
+// result surely fits, the remaining steps are left to ScalarSteps.
+template <unsigned K>
+struct JumpSteps {
+    // 3^K < 2^26, so the jump can't overflow uint128_t below 2^(102 + K).
+    static constexpr unsigned SAFE_BITS_128 = 102;
+
+    static bool steps64(uint64_t &x, uint64_t &count) {
+        const CollatzJumpTable<K> &table = collatzJumpTable<K>;
+        while (x >> K != 0) {
+            uint64_t low = x & CollatzJumpTable<K>::MASK;
+            unsigned odd = table.odd[low];
+            uint64_t next;
+            if (__builtin_mul_overflow(x >> K, table.pow3[odd], &next) ||
+                __builtin_add_overflow(next, (uint64_t) table.add[low], &next))
+                break;
+            x = next;
+            count += K + odd;
+        }
+        return ScalarSteps::steps64(x, count);
+    }
+
+    static bool steps128(uint128_t &x, uint64_t &count) {
+        const CollatzJumpTable<K> &table = collatzJumpTable<K>;
+        while (x > UINT64_MAX && (x >> (SAFE_BITS_128 + K)) == 0) {
+            uint64_t low = (uint64_t) x & CollatzJumpTable<K>::MASK;
+            unsigned odd = table.odd[low];
+            x = (x >> K) * table.pow3[odd] + table.add[low];
+            count += K + odd;
+        }
+        return ScalarSteps::steps128(x, count);
+    }
+
+    static void stepsBig(BigUInt &n, uint64_t &count) {
+        const CollatzJumpTable<K> &table = collatzJumpTable<K>;
+        while (!n.fitsUint128()) {
+            uint64_t low = n.lowLimb() & CollatzJumpTable<K>::MASK;
+            unsigned odd = table.odd[low];
+            n.shiftRight(K);
+            n.mulSmallAdd(table.pow3[odd], table.add[low]);
+            count += K + odd;
+        }
+    }
+};
+
+// Finishes the trajectory from x, which took count steps to reach, running it
+// on uint64_t, uint128_t or BigUInt, whichever is the narrowest type that
+// holds the current value.
+template <typename Steps>
+inline uint64_t finishCollatzTiered(uint128_t x, uint64_t count) {
+    while (true) {
+        if (x <= UINT64_MAX) {
+            uint64_t y = (uint64_t) x;
+            if (Steps::steps64(y, count))
+                return count;
+            x = 3 * (uint128_t) y + 1;
+            ++count;
+        }
+        if (Steps::steps128(x, count))
+            continue;
+        BigUInt n(x);
+        n.mulSmallAdd(3, 1);
+        ++count;
+        Steps::stepsBig(n, count);
+        x = n.toUint128();
+    }
+}
+
+// Tiered kernel, see finishCollatzTiered.
+template <typename Steps>
+inline uint64_t calcCollatzTiered(const InfInt &in) {
+    uint64_t count = 0;
+    assert(in > 0);
+
+    uint128_t x;
+    if (in.numberOfDigits() <= UINT128_SAFE_DIGITS) {
+        x = infIntToUint128(in);
+    }
+    else {
+        BigUInt n(in);
+        Steps::stepsBig(n, count);
+        x = n.toUint128();
+    }
+    return finishCollatzTiered<Steps>(x, count);
+}
+
+// Build with -DCOLLATZ_JUMP_BITS=K (8 <= K <= 16) to use the jump tables.
+#ifdef COLLATZ_JUMP_BITS
+typedef JumpSteps<COLLATZ_JUMP_BITS> CollatzSteps;
+#else
+typedef ScalarSteps CollatzSteps;
+#endif
+
+inline uint64_t calcCollatz(const InfInt &in) {
+    return calcCollatzTiered<CollatzSteps>(in);
+}
+
+#endif // COLLATZ_HPP
@@ -0,0 +1,235 @@
+#ifndef COLLATZBATCH_HPP
+#define COLLATZBATCH_HPP
+
+#include <cstdint>
+#include <immintrin.h>
+
+#include "lib/infint/InfInt.h"
+
+#include "collatz.hpp"
+
+// Batch kernel for many small inputs. Inputs below 2^62 are stepped in SIMD
+// lanes with the shortcut map (an odd value v becomes (3v + 1) / 2 = v + v / 2 + 1
+// and counts as two steps), which can't overflow 64 bits for such values.
+// A lane is retired when it reaches 1, or handed to the scalar kernel when
+// it grows to 2^62, and then refilled with the next input.
+
+// Computes steps[i] for values[i], 1 <= values[i] < 2^62.
+typedef void (*CollatzLanesFun)(const uint64_t *values, size_t count, uint64_t *steps);
+
+static const unsigned COLLATZ_LANE_BITS = 62;
+
+inline void collatzLanesScalar(const uint64_t *values, size_t count, uint64_t *steps) {
+    for (size_t i = 0; i < count; ++i)
+        steps[i] = finishCollatzTiered<ScalarSteps>(values[i], 0);
+}
+
+// Scalar bookkeeping of the lanes, shared by the SIMD variants.
+template <size_t LANES>
+struct CollatzLanes {
+    alignas(64) uint64_t value[LANES];
+    alignas(64) uint64_t count[LANES];
+    size_t item[LANES];
+    bool active[LANES];
+
+    const uint64_t *values;
+    size_t size;
+    uint64_t *steps;
+    size_t next;
+
+    CollatzLanes(const uint64_t *valuesArg, size_t sizeArg, uint64_t *stepsArg):
+        values(valuesArg), size(sizeArg), steps(stepsArg), next(0) {
+        for (size_t l = 0; l < LANES; ++l)
+            active[l] = refill(l);
+    }
+
+    bool refill(size_t l) {
+        if (next == size) {
+            value[l] = 1;
+            count[l] = 0;
+            return false;
+        }
+        item[l] = next;
+        value[l] = values[next++];
+        count[l] = 0;
+        return true;
+    }
+
+    void retire(size_t l) {
+        steps[item[l]] = value[l] == 1 ? count[l] : finishCollatzTiered<ScalarSteps>(value[l], count[l]);
+    }
+
+    // Retires the lanes set in doneBits and refills them. Returns false when
+    // the inputs ran out, in which case the remaining lanes were finished
+    // by the scalar kernel.
+    bool retireAndRefill(uint32_t doneBits) {
+        bool exhausted = false;
+        for (size_t l = 0; l < LANES; ++l) {
+            if (doneBits & (1u << l)) {
+                retire(l);
+                active[l] = refill(l);
+                exhausted |= !active[l];
+            }
+        }
+        if (!exhausted)
+            return true;
+
+        for (size_t l = 0; l < LANES; ++l) {
+            if (active[l])
+                retire(l);
+        }
+        return false;
+    }
+};
+
+__attribute__((target("avx2")))
+inline void collatzLanesAvx2(const uint64_t *values, size_t count, uint64_t *steps) {
+    if (count < 4) {
+        collatzLanesScalar(values, count, steps);
+        return;
+    }
+
+    CollatzLanes<4> lanes(values, count, steps);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i v = _mm256_load_si256((const __m256i *) lanes.value);
+    __m256i c = _mm256_load_si256((const __m256i *) lanes.count);
+
+    while (true) {
+        __m256i small = _mm256_cmpeq_epi64(_mm256_srli_epi64(v, COLLATZ_LANE_BITS), zero);
+        __m256i done = _mm256_or_si256(_mm256_cmpeq_epi64(v, one), _mm256_xor_si256(small, _mm256_cmpeq_epi64(zero, zero)));
+        uint32_t doneBits = _mm256_movemask_pd(_mm256_castsi256_pd(done));
+        if (doneBits != 0) {
+            _mm256_store_si256((__m256i *) lanes.value, v);
+            _mm256_store_si256((__m256i *) lanes.count, c);
+            if (!lanes.retireAndRefill(doneBits))
+                return;
+            v = _mm256_load_si256((const __m256i *) lanes.value);
+            c = _mm256_load_si256((const __m256i *) lanes.count);
+            // A refilled lane may hold 1 (or a big value) already.
+            continue;
+        }
+
+        // odd is all ones in odd lanes, so one - odd adds 2 there and 1 elsewhere.
+        __m256i odd = _mm256_cmpeq_epi64(_mm256_and_si256(v, one), one);
+        __m256i half = _mm256_srli_epi64(v, 1);
+        __m256i up = _mm256_add_epi64(_mm256_add_epi64(v, half), one);
+        v = _mm256_blendv_epi8(half, up, odd);
+        c = _mm256_add_epi64(c, _mm256_sub_epi64(one, odd));
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void collatzLanesAvx512(const uint64_t *values, size_t count, uint64_t *steps) {
+    if (count < 8) {
+        collatzLanesScalar(values, count, steps);
+        return;
+    }
+
+    CollatzLanes<8> lanes(values, count, steps);
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i v = _mm512_load_si512(lanes.value);
+    __m512i c = _mm512_load_si512(lanes.count);
+
+    // The shifts are zero-masked: GCC's unmasked _mm512_srli_epi64 passes an
+    // undefined vector through, which -Wmaybe-uninitialized reports.
+    const __mmask8 all = 0xff;
+
+    while (true) {
+        __mmask8 done = _mm512_cmpeq_epu64_mask(v, one) |
+                        _mm512_cmpneq_epu64_mask(_mm512_maskz_srli_epi64(all, v, COLLATZ_LANE_BITS), zero);
+        if (done != 0) {
+            _mm512_store_si512(lanes.value, v);
+            _mm512_store_si512(lanes.count, c);
+            if (!lanes.retireAndRefill(done))
+                return;
+            v = _mm512_load_si512(lanes.value);
+            c = _mm512_load_si512(lanes.count);
+            continue;
+        }
+
+        __mmask8 odd = _mm512_test_epi64_mask(v, one);
+        __m512i half = _mm512_maskz_srli_epi64(all, v, 1);
+        __m512i up = _mm512_add_epi64(_mm512_add_epi64(v, half), one);
+        v = _mm512_mask_blend_epi64(odd, half, up);
+        c = _mm512_add_epi64(_mm512_add_epi64(c, one), _mm512_maskz_mov_epi64(odd, one));
+    }
+}
+
+// Widest variant supported by the CPU we run on.
+inline CollatzLanesFun bestCollatzLanes() {
+    static const CollatzLanesFun best =
+        __builtin_cpu_supports("avx512f") ? collatzLanesAvx512 :
+        __builtin_cpu_supports("avx2") ? collatzLanesAvx2 :
+        collatzLanesScalar;
+    return best;
+}
+
+// Inputs for the lanes are gathered in blocks of that many, on the stack.
+static const size_t COLLATZ_BATCH_BLOCK = 512;
+
+// Runs the count gathered values through lanesFun, out[positions[i]] gets
+// the steps of values[i].
+inline void flushCollatzLanes(CollatzLanesFun lanesFun, const uint64_t *values, const size_t *positions,
+                              size_t count, uint64_t *out) {
+    uint64_t steps[COLLATZ_BATCH_BLOCK];
+    lanesFun(values, count, steps);
+    for (size_t i = 0; i < count; ++i)
+        out[positions[i]] = steps[i];
+}
+
+// out[i - begin] = calcCollatz(in[i]) for begin <= i < end, where in gives
+// the limbs of its numbers like SerializedInputs (limbformat.hpp). Inputs
+// that fit in the SIMD lanes go through lanesFun, the rest of those that
+// fit in uint128_t through finishCollatzTiered, and only the others are
+// read as InfInt (in[i]) for calcCollatz. Allocates nothing for the former.
+template <typename Inputs>
+inline void calcCollatzBatchLimbs(const Inputs &in, size_t begin, size_t end, uint64_t *out,
+                                  CollatzLanesFun lanesFun = bestCollatzLanes()) {
+    uint64_t values[COLLATZ_BATCH_BLOCK];
+    size_t positions[COLLATZ_BATCH_BLOCK];
+    size_t gathered = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        size_t limbCount = in.limbCount(i);
+        if (limbCount > UINT128_SAFE_LIMBS) {
+            out[i - begin] = calcCollatz(in[i]);
+            continue;
+        }
+
+        uint128_t x = limbsToUint128(in.limbs(i), limbCount);
+        assert(x > 0);
+        if (x >> COLLATZ_LANE_BITS != 0) {
+            out[i - begin] = finishCollatzTiered<CollatzSteps>(x, 0);
+            continue;
+        }
+
+        values[gathered] = (uint64_t) x;
+        positions[gathered++] = i - begin;
+        if (gathered == COLLATZ_BATCH_BLOCK) {
+            flushCollatzLanes(lanesFun, values, positions, gathered, out);
+            gathered = 0;
+        }
+    }
+
+    if (gathered != 0)
+        flushCollatzLanes(lanesFun, values, positions, gathered, out);
+}
+
+// Limbs of an InfInt array for calcCollatzBatchLimbs.
+struct InfIntArrayLimbs {
+    const InfInt *in;
+
+    size_t limbCount(size_t i) const { return in[i].limbCount(); }
+    const ELEM_TYPE *limbs(size_t i) const { return in[i].limbData(); }
+    const InfInt &operator[](size_t i) const { return in[i]; }
+};
+
+// out[i] = calcCollatz(in[i]) for i < count, see calcCollatzBatchLimbs.
+inline void calcCollatzBatch(const InfInt *in, size_t count, uint64_t *out,
+                             CollatzLanesFun lanesFun = bestCollatzLanes()) {
+    calcCollatzBatchLimbs(InfIntArrayLimbs{in}, 0, count, out, lanesFun);
+}
+
+#endif // COLLATZBATCH_HPP
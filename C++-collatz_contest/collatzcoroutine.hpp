@@ -0,0 +1,104 @@
+#ifndef COLLATZCOROUTINE_HPP
+#define COLLATZCOROUTINE_HPP
+
+#include <coroutine>
+#include <cstdint>
+#include <utility>
+
+#include "lib/infint/InfInt.h"
+
+#include "biguint.hpp"
+#include "collatz.hpp"
+
+// Handle of a Collatz trajectory computed as a coroutine, see
+// collatzCoroutine. Move-only, destroys the coroutine.
+class CollatzCoroutine {
+public:
+    struct promise_type {
+        uint64_t result = 0;
+        // Bit length of the value where the coroutine last suspended.
+        size_t bits = 0;
+
+        CollatzCoroutine get_return_object() {
+            return CollatzCoroutine(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(size_t bitsArg) noexcept {
+            bits = bitsArg;
+            return {};
+        }
+        void return_value(uint64_t value) noexcept { result = value; }
+        void unhandled_exception() { throw; }
+    };
+
+    CollatzCoroutine(CollatzCoroutine &&other) noexcept: handle(std::exchange(other.handle, nullptr)) {}
+
+    CollatzCoroutine& operator=(CollatzCoroutine &&other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    CollatzCoroutine(const CollatzCoroutine&) = delete;
+    CollatzCoroutine& operator=(const CollatzCoroutine&) = delete;
+
+    ~CollatzCoroutine() {
+        if (handle)
+            handle.destroy();
+    }
+
+    // Runs until the next suspension point or the end of the trajectory.
+    void resume() { handle.resume(); }
+    bool done() const { return handle.done(); }
+    uint64_t result() const { return handle.promise().result; }
+    size_t bits() const { return handle.promise().bits; }
+
+private:
+    explicit CollatzCoroutine(std::coroutine_handle<promise_type> handleArg): handle(handleArg) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Rough bit length of in, a decimal digit is log2(10) bits.
+inline size_t estimatedBits(const InfInt &in) {
+    return in.numberOfDigits() * 10 / 3 + 1;
+}
+
+// Collatz steps of in, as a coroutine that starts suspended and suspends
+// again after about every quantum steps (never for quantum = 0), yielding
+// the bit length of the current value as an estimate of the work left.
+// It only suspends while the value needs a BigUInt: once it fits in
+// uint128_t the rest of the trajectory takes microseconds.
+// in must outlive the coroutine.
+inline CollatzCoroutine collatzCoroutine(const InfInt &in, uint64_t quantum) {
+    uint64_t count = 0;
+    assert(in > 0);
+
+    uint128_t x;
+    if (in.numberOfDigits() <= UINT128_SAFE_DIGITS) {
+        x = infIntToUint128(in);
+    }
+    else {
+        BigUInt n(in);
+        uint64_t nextYield = quantum;
+        while (!n.fitsUint128()) {
+            if (n.isOdd()) {
+                n.mulSmallAdd(3, 1);
+                ++count;
+            }
+            count += n.stripTrailingZeros();
+            if (quantum != 0 && count >= nextYield) {
+                nextYield = count + quantum;
+                co_yield n.bitLength();
+            }
+        }
+        x = n.toUint128();
+    }
+    co_return finishCollatzTiered<ScalarSteps>(x, count);
+}
+
+#endif // COLLATZCOROUTINE_HPP
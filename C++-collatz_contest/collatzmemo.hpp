@@ -0,0 +1,93 @@
+#ifndef COLLATZMEMO_HPP
+#define COLLATZMEMO_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "lib/infint/InfInt.h"
+
+#include "collatz.hpp"
+#include "sharedresults.hpp"
+
+// Runs the trajectory on uint64_t like ScalarSteps::steps64, but looks every
+// value below the policy bound up in shared first. Returns true with the
+// total in total once the trajectory reaches 1 or a cached value, false if
+// 3y + 1 would overflow. Values to be written back are appended to path as
+// (value, steps taken to reach it).
+template<typename Shared>
+inline bool memoSteps64(uint64_t &y, uint64_t &count, Shared &shared,
+                        std::vector<std::pair<uint64_t, uint64_t>> &path, uint64_t &total) {
+    const MemoPolicy &policy = shared.getMemoPolicy();
+    while (y != 1) {
+        if (y < policy.bound) {
+            auto cached = shared.tryRead(y);
+            if (cached.first) {
+                total = count + cached.second;
+                return true;
+            }
+            if (count % policy.stride == 0)
+                path.emplace_back(y, count);
+        }
+
+        if (y & 1) {
+            if (y > UINT64_ODD_LIMIT)
+                return false;
+            y = 3 * y + 1;
+        }
+        else {
+            y >>= 1;
+        }
+        ++count;
+    }
+    total = count;
+    return true;
+}
+
+// Kernel of the X teams. Values of the trajectory that fit in uint64_t are
+// looked up in shared and the kernel stops at the first one already known;
+// the values it walked through are then written back as the MemoPolicy of
+// shared says, so overlapping trajectories are computed only once.
+// Shared is SharedResults, or ShmSharedResults for teams of processes.
+template<typename Shared>
+inline uint64_t calcCollatzShared(const InfInt &in, Shared &shared) {
+    thread_local std::vector<std::pair<uint64_t, uint64_t>> path;
+    path.clear();
+
+    uint64_t count = 0;
+    assert(in > 0);
+
+    uint128_t x;
+    if (in.numberOfDigits() <= UINT128_SAFE_DIGITS) {
+        x = infIntToUint128(in);
+    }
+    else {
+        BigUInt n(in);
+        ScalarSteps::stepsBig(n, count);
+        x = n.toUint128();
+    }
+
+    uint64_t total;
+    while (true) {
+        if (x <= UINT64_MAX) {
+            uint64_t y = (uint64_t) x;
+            if (memoSteps64(y, count, shared, path, total))
+                break;
+            x = 3 * (uint128_t) y + 1;
+            ++count;
+        }
+        if (ScalarSteps::steps128(x, count))
+            continue;
+        BigUInt n(x);
+        n.mulSmallAdd(3, 1);
+        ++count;
+        ScalarSteps::stepsBig(n, count);
+        x = n.toUint128();
+    }
+
+    for (auto const & visited : path)
+        shared.assignComputed(visited.first, total - visited.second);
+    return total;
+}
+
+#endif // COLLATZMEMO_HPP
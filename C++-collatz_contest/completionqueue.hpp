@@ -0,0 +1,119 @@
+#ifndef COMPLETIONQUEUE_HPP
+#define COMPLETIONQUEUE_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <new>
+#include <sys/mman.h>
+
+#include "futex.hpp"
+
+// Indices of finished contest elements in the order they finish, pushed by
+// any number of workers and popped by one consumer. There is a slot for
+// every element, so a push never waits. It lives in MAP_SHARED anonymous
+// memory and is synchronised only with lock-free atomics and a futex, so
+// it also works between a parent and the children it forks afterwards.
+//
+// A push claims the next slot, stores index + 1 into it and bumps the
+// published count. The consumer sleeps on that count while its next slot
+// is still 0. The result of a popped index is read from the (equally
+// shared) result array: the worker writes it before the slot.
+class CompletionQueue {
+public:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "atomics in shared memory have to be address-free");
+
+    explicit CompletionQueue(size_t capacityArg): capacity(capacityArg), head(0) {
+        void *mapped = mmap(nullptr, bytes(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+        control = new (mapped) Control();
+        slots = reinterpret_cast<std::atomic<uint64_t>*>(control + 1);
+    }
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    ~CompletionQueue() { munmap(control, bytes()); }
+
+    // Any worker, at most capacity times in total.
+    void push(size_t index) {
+        uint64_t pos = control->claimed.fetch_add(1, std::memory_order_relaxed);
+        assert(pos < capacity);
+        slots[pos].store(index + 1, std::memory_order_release);
+        control->published.fetch_add(1, std::memory_order_seq_cst);
+        if (control->waiting.load(std::memory_order_seq_cst))
+            futexWake(control->published, 1);
+    }
+
+    // The consumer only: index of the next element to finish, waits for it.
+    size_t pop() {
+        assert(head < capacity);
+        uint64_t slot;
+        while ((slot = slots[head].load(std::memory_order_acquire)) == 0) {
+            uint32_t published = control->published.load(std::memory_order_seq_cst);
+            control->waiting.store(1, std::memory_order_seq_cst);
+            if (slots[head].load(std::memory_order_acquire) == 0)
+                futexWait(control->published, published);
+            control->waiting.store(0, std::memory_order_relaxed);
+        }
+        ++head;
+        return slot - 1;
+    }
+
+    // pop that waits for at most about timeout, false if nothing came.
+    // Pushes of later slots wake it too, so it can give up earlier.
+    bool popFor(size_t &index, const timespec &timeout) {
+        assert(head < capacity);
+        uint64_t slot = slots[head].load(std::memory_order_acquire);
+        if (slot == 0) {
+            uint32_t published = control->published.load(std::memory_order_seq_cst);
+            control->waiting.store(1, std::memory_order_seq_cst);
+            if ((slot = slots[head].load(std::memory_order_acquire)) == 0) {
+                futexWait(control->published, published, &timeout);
+                slot = slots[head].load(std::memory_order_acquire);
+            }
+            control->waiting.store(0, std::memory_order_relaxed);
+            if (slot == 0)
+                return false;
+        }
+        ++head;
+        index = slot - 1;
+        return true;
+    }
+
+    // The consumer only, once every push has been popped: empties the queue
+    // to take capacity pushes again.
+    void reset() {
+        uint64_t claimed = control->claimed.load(std::memory_order_relaxed);
+        assert(head == claimed);
+        for (uint64_t i = 0; i < claimed; ++i)
+            slots[i].store(0, std::memory_order_relaxed);
+        control->claimed.store(0, std::memory_order_relaxed);
+        control->published.store(0, std::memory_order_relaxed);
+        head = 0;
+    }
+
+private:
+    struct Control {
+        // Slots handed out to pushes.
+        std::atomic<uint64_t> claimed{0};
+        // Slots filled, the futex word.
+        std::atomic<uint32_t> published{0};
+        // Set while the consumer may sleep, so pushes wake it only then.
+        std::atomic<uint32_t> waiting{0};
+    };
+
+    size_t bytes() const { return sizeof(Control) + capacity * sizeof(std::atomic<uint64_t>); }
+
+    const size_t capacity;
+    // Next slot to pop, private to the consumer.
+    size_t head;
+    Control *control;
+    std::atomic<uint64_t> *slots;
+};
+
+#endif // COMPLETIONQUEUE_HPP
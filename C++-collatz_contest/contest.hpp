@@ -1,10 +1,13 @@
 #ifndef CONTEST_HPP
 #define CONTEST_HPP
 
+#include <functional>
 #include <vector>
 #include "lib/infint/InfInt.h"
 
 typedef std::vector<InfInt> ContestInput;
 typedef std::vector<uint64_t> ContestResult;
+// Gets the index of a contest element and its result.
+typedef std::function<void(size_t, uint64_t)> ResultCallback;
 
 #endif // CONTEST_HPP
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef COSTMODEL_HPP
+#define COSTMODEL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "lib/infint/InfInt.h"
+
+#include "contest.hpp"
+
+// Estimated cost of calcCollatz(n) from its bit length b alone: the
+// trajectory has about 10b steps, and a step on a number of more than 64
+// bits costs about one unit per 64-bit limb.
+inline uint64_t bitLengthCost(const InfInt &n) {
+    // log2(10) ~ 3.32 bits per decimal digit.
+    uint64_t bits = n.numberOfDigits() * 332 / 100 + 1;
+    return bits * (bits / 64 + 1);
+}
+
+inline std::vector<uint64_t> elementCosts(const ContestInput &input) {
+    std::vector<uint64_t> costs(input.size());
+    for (size_t i = 0; i < input.size(); ++i)
+        costs[i] = bitLengthCost(input[i]);
+    return costs;
+}
+
+// prefix[i] is the estimated cost of input[0..i), prefix has input.size() + 1 items.
+inline std::vector<uint64_t> costPrefixSums(const ContestInput &input) {
+    std::vector<uint64_t> prefix(input.size() + 1);
+    prefix[0] = 0;
+    for (size_t i = 0; i < input.size(); ++i)
+        prefix[i + 1] = prefix[i] + bitLengthCost(input[i]);
+    return prefix;
+}
+
+// Splits elements with the given costs into parts of similar total cost
+// with the LPT rule: in order of decreasing cost, each element goes to the
+// least loaded part. The largest part costs at most 4/3 of the optimum.
+// Indices within a part are sorted.
+inline std::vector<std::vector<size_t>> partitionLpt(const std::vector<uint64_t> &costs, uint32_t parts) {
+    std::vector<size_t> order(costs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    // Min-heap of (load, part).
+    std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t>>,
+                        std::greater<std::pair<uint64_t, uint32_t>>> loads;
+    for (uint32_t part = 0; part < parts; ++part)
+        loads.push({0, part});
+
+    std::vector<std::vector<size_t>> result(parts);
+    for (size_t i : order) {
+        auto least = loads.top();
+        loads.pop();
+        result[least.second].push_back(i);
+        loads.push({least.first + costs[i], least.second});
+    }
+    for (auto &part : result)
+        std::sort(part.begin(), part.end());
+    return result;
+}
+
+#endif // COSTMODEL_HPP
@@ -0,0 +1,142 @@
+#ifndef FORKJOIN_HPP
+#define FORKJOIN_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running fork-join tasks, created once and reused.
+//
+// A forked task waits in a shared queue until a worker takes it. Joining a
+// task nobody has taken yet takes it back and runs it inline; joining one
+// that is running helps with other queued tasks meanwhile. So nested
+// fork-join never leaves a thread blocked while there is work, and the
+// forking thread does its share instead of only waiting.
+class ForkJoinExecutor {
+public:
+    // Lives on the forking thread's stack until it is joined.
+    class Task {
+    public:
+        explicit Task(std::function<void()> fnArg): fn(std::move(fnArg)), queued(false), done(false) {}
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+    private:
+        friend class ForkJoinExecutor;
+
+        std::function<void()> fn;
+        // Both guarded by the executor's mutex.
+        bool queued;
+        bool done;
+        std::exception_ptr error;
+    };
+
+    explicit ForkJoinExecutor(uint32_t workers): stop(false) {
+        for (uint32_t i = 0; i < workers; ++i)
+            threads.emplace_back(&ForkJoinExecutor::workerLoop, this);
+    }
+
+    ForkJoinExecutor(const ForkJoinExecutor&) = delete;
+    ForkJoinExecutor& operator=(const ForkJoinExecutor&) = delete;
+
+    ~ForkJoinExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        queueCv.notify_all();
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+    uint32_t getWorkers() const { return threads.size(); }
+
+    void fork(Task &task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task.queued = true;
+            queue.push_back(&task);
+        }
+        queueCv.notify_one();
+        // Joiners waiting for a running task may help with this one.
+        doneCv.notify_all();
+    }
+
+    // Rethrows what the task threw.
+    void join(Task &task) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (task.queued) {
+            queue.erase(std::find(queue.rbegin(), queue.rend(), &task).base() - 1);
+            task.queued = false;
+            lock.unlock();
+            task.fn();
+            return;
+        }
+
+        while (!task.done) {
+            if (!queue.empty())
+                runOne(lock, false);
+            else
+                doneCv.wait(lock);
+        }
+        if (task.error)
+            std::rethrow_exception(task.error);
+    }
+
+private:
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            queueCv.wait(lock, [this]() { return stop || !queue.empty(); });
+            if (queue.empty())
+                return;
+            runOne(lock, true);
+        }
+    }
+
+    // Runs the oldest queued task (the biggest part of the work, for idle
+    // workers) or the newest one (for joiners). Called and returns with
+    // lock held, the queue must not be empty.
+    void runOne(std::unique_lock<std::mutex> &lock, bool oldest) {
+        Task *task;
+        if (oldest) {
+            task = queue.front();
+            queue.pop_front();
+        }
+        else {
+            task = queue.back();
+            queue.pop_back();
+        }
+        task->queued = false;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            task->fn();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        task->error = error;
+        task->done = true;
+        doneCv.notify_all();
+    }
+
+    std::mutex mutex;
+    std::condition_variable queueCv;
+    std::condition_variable doneCv;
+    std::deque<Task*> queue;
+    bool stop;
+    std::vector<std::thread> threads;
+};
+
+#endif // FORKJOIN_HPP
@@ -0,0 +1,21 @@
+#ifndef FUTEX_HPP
+#define FUTEX_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Futex on a word of MAP_SHARED memory, so not FUTEX_PRIVATE_FLAG. A
+// timeout is relative, and without one the wait can be endless.
+inline void futexWait(std::atomic<uint32_t> &word, uint32_t expected, const timespec *timeout = nullptr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t> &word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+#endif // FUTEX_HPP
@@ -0,0 +1,53 @@
+#ifndef JUMPTABLE_HPP
+#define JUMPTABLE_HPP
+
+#include <cstdint>
+
+// Tables for advancing the Collatz trajectory by K steps of the shortcut map
+// T(n) = n / 2 (n even), (3n + 1) / 2 (n odd) at once.
+//
+// Writing n = 2^K * h + l with l < 2^K, after K applications of T
+//     n -> 3^odd[l] * h + add[l],
+// which is K + odd[l] steps of the plain Collatz map (each odd step of T
+// is 3n + 1 followed by a halving). The trajectory can't pass through 1
+// within those steps as long as n >= 2^K.
+template <unsigned K>
+struct CollatzJumpTable {
+    static_assert(K >= 8 && K <= 16, "jump tables are generated for 8 <= K <= 16");
+
+    static constexpr uint64_t SIZE = 1ULL << K;
+    static constexpr uint64_t MASK = SIZE - 1;
+
+    uint32_t add[SIZE];
+    uint8_t odd[SIZE];
+    uint64_t pow3[K + 1];
+
+    constexpr CollatzJumpTable(): add(), odd(), pow3() {
+        pow3[0] = 1;
+        for (unsigned i = 1; i <= K; ++i)
+            pow3[i] = pow3[i - 1] * 3;
+
+        for (uint64_t l = 0; l < SIZE; ++l) {
+            // n = a * h + b, a starts as 2^K and stays even until the last step,
+            // so the parity of n is the parity of b.
+            uint64_t b = l;
+            uint8_t c = 0;
+            for (unsigned step = 0; step < K; ++step) {
+                if (b & 1) {
+                    b = (3 * b + 1) / 2;
+                    ++c;
+                }
+                else {
+                    b /= 2;
+                }
+            }
+            add[l] = (uint32_t) b;
+            odd[l] = c;
+        }
+    }
+};
+
+template <unsigned K>
+inline constexpr CollatzJumpTable<K> collatzJumpTable{};
+
+#endif // JUMPTABLE_HPP
@@ -16,6 +16,10 @@
  *      digitAt:        returns digit at index
  *      numberOfDigits: returns number of digits
  *      size:           returns size in bytes
+ *      hash:           returns hash of the number
+ *      limbCount:      returns number of limbs (base 10^9, least significant first)
+ *      limbData:       returns pointer to the limbs
+ *      fromLimbs:      creates a non-negative number from such limbs
  *      toString:       converts it to a string
  *
  *   There are also conversion methods which allow conversion to primitive types:
@@ -25,6 +29,10 @@
  *   InfIntException in case of error instead of writing error messages using
  *   std::cerr.
  *
+ *   Up to INFINT_INLINE_LIMBS limbs (9 digits each) are stored inside the
+ *   InfInt object itself, only larger numbers allocate their limbs on the
+ *   heap. Define it to change the default of 4.
+ *
  *   See ReadMe.txt for more info.
  *
  *
@@ -40,6 +48,8 @@
 #include <sstream>
 #include <iomanip>
 #include <climits>
+#include <cstring>
+#include <utility>
 
 //#include <limits.h>
 //#include <stdlib.h>
@@ -111,6 +121,157 @@ inline static lldiv_t my_lldiv(long long num, long long denom)
     return result;
 }
 
+#ifndef INFINT_INLINE_LIMBS
+#define INFINT_INLINE_LIMBS 4
+#endif
+
+/* limb storage with room for INFINT_INLINE_LIMBS limbs inside the object */
+class InfIntLimbs
+{
+public:
+    typedef ELEM_TYPE* iterator;
+    typedef const ELEM_TYPE* const_iterator;
+
+    InfIntLimbs() : buf(local), len(0), cap(INFINT_INLINE_LIMBS)
+    {
+    }
+
+    InfIntLimbs(const InfIntLimbs& l) : buf(local), len(0), cap(INFINT_INLINE_LIMBS)
+    {
+        *this = l;
+    }
+
+    InfIntLimbs(InfIntLimbs&& l) noexcept : buf(local), len(0), cap(INFINT_INLINE_LIMBS)
+    {
+        *this = std::move(l);
+    }
+
+    ~InfIntLimbs()
+    {
+        if (buf != local)
+        {
+            delete[] buf;
+        }
+    }
+
+    InfIntLimbs& operator=(const InfIntLimbs& l)
+    {
+        if (this != &l)
+        {
+            len = 0;
+            reserve(l.len);
+            std::memcpy(buf, l.buf, l.len * sizeof(ELEM_TYPE));
+            len = l.len;
+        }
+        return *this;
+    }
+
+    InfIntLimbs& operator=(InfIntLimbs&& l) noexcept
+    {
+        if (this == &l)
+        {
+            return *this;
+        }
+        if (l.buf == l.local)
+        {
+            // inline limbs are copied, they always fit in the capacity of this
+            std::memcpy(buf, l.buf, l.len * sizeof(ELEM_TYPE));
+            len = l.len;
+        }
+        else
+        {
+            if (buf != local)
+            {
+                delete[] buf;
+            }
+            buf = l.buf;
+            len = l.len;
+            cap = l.cap;
+            l.buf = l.local;
+            l.cap = INFINT_INLINE_LIMBS;
+        }
+        l.len = 0;
+        return *this;
+    }
+
+    size_t size() const { return len; }
+    size_t capacity() const { return cap; }
+    ELEM_TYPE& operator[](size_t i) { return buf[i]; }
+    const ELEM_TYPE& operator[](size_t i) const { return buf[i]; }
+    ELEM_TYPE& back() { return buf[len - 1]; }
+    const ELEM_TYPE& back() const { return buf[len - 1]; }
+    iterator begin() { return buf; }
+    iterator end() { return buf + len; }
+    const_iterator begin() const { return buf; }
+    const_iterator end() const { return buf + len; }
+
+    void clear()
+    {
+        len = 0;
+    }
+
+    void reserve(size_t n)
+    {
+        if (n <= cap)
+        {
+            return;
+        }
+        size_t newCap = n > 2 * cap ? n : 2 * cap;
+        ELEM_TYPE* newBuf = new ELEM_TYPE[newCap];
+        std::memcpy(newBuf, buf, len * sizeof(ELEM_TYPE));
+        if (buf != local)
+        {
+            delete[] buf;
+        }
+        buf = newBuf;
+        cap = newCap;
+    }
+
+    void resize(size_t n, ELEM_TYPE value = 0)
+    {
+        reserve(n);
+        for (size_t i = len; i < n; ++i)
+        {
+            buf[i] = value;
+        }
+        len = n;
+    }
+
+    void push_back(ELEM_TYPE value)
+    {
+        reserve(len + 1);
+        buf[len++] = value;
+    }
+
+    void pop_back()
+    {
+        --len;
+    }
+
+    iterator insert(iterator position, ELEM_TYPE value)
+    {
+        size_t index = position - buf;
+        reserve(len + 1);
+        std::memmove(buf + index + 1, buf + index, (len - index) * sizeof(ELEM_TYPE));
+        buf[index] = value;
+        ++len;
+        return buf + index;
+    }
+
+    iterator erase(iterator position)
+    {
+        std::memmove(position, position + 1, (end() - position - 1) * sizeof(ELEM_TYPE));
+        --len;
+        return position;
+    }
+
+private:
+    ELEM_TYPE* buf;
+    size_t len;
+    size_t cap;
+    ELEM_TYPE local[INFINT_INLINE_LIMBS];
+};
+
 class InfInt
 {
     friend std::ostream& operator<<(std::ostream &s, const InfInt &n);
@@ -128,6 +289,7 @@ public:
     InfInt(unsigned long l);
     InfInt(unsigned long long l);
     InfInt(const InfInt& l);
+    InfInt(InfInt&& l) noexcept;
 
     /* assignment operators */
     const InfInt& operator=(const char* c);
@@ -139,6 +301,7 @@ public:
     const InfInt& operator=(unsigned long l);
     const InfInt& operator=(unsigned long long l);
     const InfInt& operator=(const InfInt& l);
+    const InfInt& operator=(InfInt&& l) noexcept;
 
     /* unary increment/decrement operators */
     const InfInt& operator++();
@@ -171,6 +334,11 @@ public:
     bool operator>(const InfInt& rhs) const;
     bool operator>=(const InfInt& rhs) const;
 
+    /* in-place operations with a single limb, they do not allocate unless the number grows */
+    void mulSmallAdd(ELEM_TYPE mul, ELEM_TYPE add); // *this = *this * mul + add, for *this >= 0, 0 <= mul, add < BASE
+    ELEM_TYPE divSmall(ELEM_TYPE rhs); // *this /= rhs and returns *this % rhs // throw
+    bool isOdd() const;
+
     /* integer square root */
     InfInt intSqrt() const; // throw
 
@@ -181,6 +349,14 @@ public:
     /* size in bytes */
     size_t size() const;
 
+    /* hash of the sign and limbs */
+    size_t hash() const;
+
+    /* raw limbs, least significant first, each in [0, BASE) */
+    size_t limbCount() const;
+    const ELEM_TYPE* limbData() const;
+    static InfInt fromLimbs(const ELEM_TYPE* limbs, size_t count); // limbs without leading zeros
+
     /* string conversion */
     std::string toString() const;
 
@@ -194,7 +370,8 @@ public:
 
 private:
     static ELEM_TYPE dInR(const InfInt& R, const InfInt& D);
-    static void multiplyByDigit(ELEM_TYPE factor, std::vector<ELEM_TYPE>& val);
+    ELEM_TYPE modSmall(ELEM_TYPE rhs) const;
+    static void multiplyByDigit(ELEM_TYPE factor, InfIntLimbs& val);
 
     void correct(bool justCheckLeadingZeros = false, bool hasValidSign = false);
     void fromString(const std::string& s);
@@ -203,7 +380,7 @@ private:
     bool equalizeSigns();
     void removeLeadingZeros();
 
-    std::vector<ELEM_TYPE> val; // number with base FACTOR
+    InfIntLimbs val; // number with base FACTOR
     bool pos; // true if number is positive
 };
 
@@ -341,6 +518,13 @@ inline InfInt::InfInt(const InfInt& l) : pos(l.pos), val(l.val)
     //PROFINY_SCOPE
 }
 
+inline InfInt::InfInt(InfInt&& l) noexcept : val(std::move(l.val)), pos(l.pos)
+{
+    //PROFINY_SCOPE
+    l.pos = true;
+    l.val.push_back((ELEM_TYPE) 0);
+}
+
 inline const InfInt& InfInt::operator=(const char* c)
 {
     //PROFINY_SCOPE
@@ -480,6 +664,19 @@ inline const InfInt& InfInt::operator=(const InfInt& l)
     return *this;
 }
 
+inline const InfInt& InfInt::operator=(InfInt&& l) noexcept
+{
+    //PROFINY_SCOPE
+    if (this != &l)
+    {
+        pos = l.pos;
+        val = std::move(l.val);
+        l.pos = true;
+        l.val.push_back((ELEM_TYPE) 0);
+    }
+    return *this;
+}
+
 inline const InfInt& InfInt::operator++()
 {
     //PROFINY_SCOPE
@@ -547,7 +744,11 @@ inline const InfInt& InfInt::operator-=(const InfInt& rhs)
 inline const InfInt& InfInt::operator*=(const InfInt& rhs)
 {
     //PROFINY_SCOPE
-    // TODO: optimize (do not use operator*)
+    if (rhs.val.size() == 1)
+    {
+        return *this *= (rhs.pos ? rhs.val[0] : -rhs.val[0]);
+    }
+    // the product needs limbs of its own, it is moved into *this
     *this = *this * rhs;
     return *this;
 }
@@ -564,6 +765,11 @@ inline const InfInt& InfInt::operator/=(const InfInt& rhs)
         return *this;
 #endif
     }
+    if (rhs.val.size() == 1)
+    {
+        divSmall(rhs.pos ? rhs.val[0] : -rhs.val[0]);
+        return *this;
+    }
     InfInt R, D = (rhs.pos ? rhs : -rhs), N = (pos ? *this : -*this);
     bool oldpos = pos;
     std::fill(val.begin(), val.end(), 0);
@@ -583,7 +789,12 @@ inline const InfInt& InfInt::operator/=(const InfInt& rhs)
 inline const InfInt& InfInt::operator%=(const InfInt& rhs)
 {
     //PROFINY_SCOPE
-    // TODO: optimize (do not use operator%)
+    if (rhs.val.size() == 1 && rhs.val[0] != 0)
+    {
+        *this = modSmall(rhs.pos ? rhs.val[0] : -rhs.val[0]);
+        return *this;
+    }
+    // long division, the remainder is moved into *this
     *this = *this % rhs;
     return *this;
 //    if (rhs == 0)
@@ -612,6 +823,11 @@ inline const InfInt& InfInt::operator%=(const InfInt& rhs)
 inline const InfInt& InfInt::operator*=(ELEM_TYPE rhs)
 {
     //PROFINY_SCOPE
+    if (pos && rhs >= 0 && rhs < BASE)
+    {
+        mulSmallAdd(rhs, 0);
+        return *this;
+    }
     ELEM_TYPE factor = rhs < 0 ? -rhs : rhs;
     bool oldpos = pos;
     multiplyByDigit(factor, val);
@@ -708,6 +924,12 @@ inline InfInt InfInt::operator/(const InfInt& rhs) const
         return 0;
 #endif
     }
+    if (rhs.val.size() == 1)
+    {
+        InfInt Q = *this;
+        Q.divSmall(rhs.pos ? rhs.val[0] : -rhs.val[0]);
+        return Q;
+    }
     InfInt Q, R, D = (rhs.pos ? rhs : -rhs), N = (pos ? *this : -*this);
     Q.val.resize(N.val.size(), 0);
     for (int i = (int) N.val.size() - 1; i >= 0; --i)
@@ -735,6 +957,10 @@ inline InfInt InfInt::operator%(const InfInt& rhs) const
         return 0;
 #endif
     }
+    if (rhs.val.size() == 1)
+    {
+        return modSmall(rhs.pos ? rhs.val[0] : -rhs.val[0]);
+    }
     InfInt R, D = (rhs.pos ? rhs : -rhs), N = (pos ? *this : -*this);
     for (int i = (int) N.val.size() - 1; i >= 0; --i)
     {
@@ -943,6 +1169,65 @@ inline void InfInt::optimizeSqrtSearchBounds(InfInt& lo, InfInt& hi) const
     }
 }
 
+inline void InfInt::mulSmallAdd(ELEM_TYPE mul, ELEM_TYPE add)
+{
+    //PROFINY_SCOPE
+    PRODUCT_TYPE carry = add;
+    for (size_t i = 0; i < val.size(); ++i)
+    {
+        lldiv_t dt = my_lldiv(val[i] * (PRODUCT_TYPE) mul + carry, BASE);
+        val[i] = (ELEM_TYPE) dt.rem;
+        carry = dt.quot;
+    }
+    if (carry > 0)
+    {
+        val.push_back((ELEM_TYPE) carry);
+    }
+    removeLeadingZeros();
+}
+
+inline ELEM_TYPE InfInt::divSmall(ELEM_TYPE rhs)
+{
+    //PROFINY_SCOPE
+    if (rhs == 0)
+    {
+#ifdef INFINT_USE_EXCEPTIONS
+        throw InfIntException("division by zero");
+#else
+        std::cerr << "Division by zero!" << std::endl;
+        return 0;
+#endif
+    }
+    bool oldpos = pos;
+    PRODUCT_TYPE divisor = rhs < 0 ? -(PRODUCT_TYPE) rhs : rhs, remainder = 0;
+    for (int i = (int) val.size() - 1; i >= 0; --i)
+    {
+        lldiv_t dt = my_lldiv(remainder * BASE + val[i], divisor);
+        val[i] = (ELEM_TYPE) dt.quot;
+        remainder = dt.rem;
+    }
+    removeLeadingZeros();
+    pos = (val.size() == 1 && val[0] == 0) ? true : (oldpos == (rhs > 0));
+    return (ELEM_TYPE) (oldpos ? remainder : -remainder);
+}
+
+inline ELEM_TYPE InfInt::modSmall(ELEM_TYPE rhs) const
+{
+    //PROFINY_SCOPE
+    PRODUCT_TYPE divisor = rhs < 0 ? -(PRODUCT_TYPE) rhs : rhs, remainder = 0;
+    for (int i = (int) val.size() - 1; i >= 0; --i)
+    {
+        remainder = (remainder * BASE + val[i]) % divisor;
+    }
+    return (ELEM_TYPE) (pos ? remainder : -remainder);
+}
+
+inline bool InfInt::isOdd() const
+{
+    //PROFINY_SCOPE
+    return val[0] % 2 != 0;
+}
+
 inline InfInt InfInt::intSqrt() const
 {
     //PROFINY_SCOPE
@@ -1015,6 +1300,41 @@ inline size_t InfInt::size() const
     return val.size() * sizeof(ELEM_TYPE) + sizeof(bool);
 }
 
+inline size_t InfInt::hash() const
+{
+    //PROFINY_SCOPE
+    size_t h = pos ? 0 : 1;
+    for (size_t i = 0; i < val.size(); ++i)
+    {
+        h ^= (size_t) val[i] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+inline size_t InfInt::limbCount() const
+{
+    //PROFINY_SCOPE
+    return val.size();
+}
+
+inline const ELEM_TYPE* InfInt::limbData() const
+{
+    //PROFINY_SCOPE
+    return val.begin();
+}
+
+inline InfInt InfInt::fromLimbs(const ELEM_TYPE* limbs, size_t count)
+{
+    //PROFINY_SCOPE
+    InfInt result;
+    if (count > 0)
+    {
+        result.val.resize(count);
+        std::memcpy(result.val.begin(), limbs, count * sizeof(ELEM_TYPE));
+    }
+    return result;
+}
+
 inline int InfInt::toInt() const
 {
     //PROFINY_SCOPE
@@ -1307,7 +1627,7 @@ inline ELEM_TYPE InfInt::dInR(const InfInt& R, const InfInt& D)
     return min;
 }
 
-inline void InfInt::multiplyByDigit(ELEM_TYPE factor, std::vector<ELEM_TYPE>& val)
+inline void InfInt::multiplyByDigit(ELEM_TYPE factor, InfIntLimbs& val)
 {
     //PROFINY_SCOPE
     ELEM_TYPE carry = 0;
@@ -8,12 +8,20 @@
 #include <mutex>
 #include <future>
 #include <stdexcept>
-#include <queue>
 #include <utility>
 #include <functional>
 #include <vector>
 #include <chrono>
 #include <cstddef>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
 
 
 namespace cxxpool {
@@ -120,46 +128,234 @@ get(Iterator first, Iterator last) {
 namespace detail {
 
 
-template<typename Index, Index max = std::numeric_limits<Index>::max()>
-class infinite_counter {
+// Thread-safe free lists of memory blocks in a few size classes, used for
+// the shared states of futures and bulk pushes. Freed blocks are kept for
+// reuse and never given back, so once warmed up these allocations do not
+// touch the global allocator. Blocks above the largest class go to it.
+class block_pool {
 public:
+    static constexpr std::size_t min_block = 64;
+    static constexpr std::size_t n_classes = 4; // 64, 128, 256, 512 bytes
 
-    infinite_counter()
-    : count_{0}
-    {}
+    // The pool is never destroyed: futures may release their shared state
+    // during static destruction
+    static block_pool& instance() {
+        static block_pool* pool = new block_pool;
+        return *pool;
+    }
 
-    infinite_counter& operator++() {
-        if (count_.back() == max)
-            count_.push_back(0);
-        else
-            ++count_.back();
-        return *this;
+    void* allocate(std::size_t bytes) {
+        const std::size_t size_class = class_of(bytes);
+        if (size_class == n_classes)
+            return ::operator new(bytes);
+        {
+            std::lock_guard<std::mutex> lock(classes_[size_class].mutex);
+            free_block* block = classes_[size_class].head;
+            if (block) {
+                classes_[size_class].head = block->next;
+                return block;
+            }
+        }
+        return ::operator new(min_block << size_class);
     }
 
-    bool operator>(const infinite_counter& other) const {
-        if (count_.size() == other.count_.size()) {
-            return count_.back() > other.count_.back();
-        } else {
-            return count_.size() > other.count_.size();
+    void deallocate(void* pointer, std::size_t bytes) {
+        const std::size_t size_class = class_of(bytes);
+        if (size_class == n_classes) {
+            ::operator delete(pointer);
+            return;
         }
+        free_block* block = static_cast<free_block*>(pointer);
+        std::lock_guard<std::mutex> lock(classes_[size_class].mutex);
+        block->next = classes_[size_class].head;
+        classes_[size_class].head = block;
     }
 
 private:
-    std::vector<Index> count_;
+    struct free_block {
+        free_block* next;
+    };
+
+    struct alignas(64) free_list {
+        std::mutex mutex;
+        free_block* head = nullptr;
+    };
+
+    static std::size_t class_of(std::size_t bytes) {
+        std::size_t size_class = 0;
+        while (size_class < n_classes && (min_block << size_class) < bytes)
+            ++size_class;
+        return size_class;
+    }
+
+    free_list classes_[n_classes];
 };
 
 
-class priority_task {
+// Standard allocator on top of block_pool, e.g. for std::promise
+template<typename T>
+class pool_allocator {
+public:
+    typedef T value_type;
+
+    pool_allocator() noexcept {}
+
+    template<typename U>
+    pool_allocator(const pool_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(block_pool::instance().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n) noexcept {
+        block_pool::instance().deallocate(pointer, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const pool_allocator<U>&) const noexcept { return true; }
+
+    template<typename U>
+    bool operator!=(const pool_allocator<U>&) const noexcept { return false; }
+};
+
+
+// Promise whose shared state lives in block_pool
+template<typename R>
+std::promise<R> make_pool_promise() {
+    return std::promise<R>{std::allocator_arg, pool_allocator<R>{}};
+}
+
+
+// Move-only type-erased void() callable. Callables of up to buffer_size
+// bytes are stored inline, larger ones in a block_pool block.
+class task_function {
 public:
-    typedef std::size_t counter_elem_t;
+    static constexpr std::size_t buffer_size = 96;
 
-    priority_task()
-    : callback_{}, priority_{}, order_{}
+    task_function() noexcept
+    : invoke_{nullptr}, manage_{nullptr}
     {}
 
-    // cppcheck-suppress passedByValue
-    priority_task(std::function<void()> callback, std::size_t priority, cxxpool::detail::infinite_counter<counter_elem_t> order)
-    : callback_{std::move(callback)}, priority_(priority), order_{std::move(order)}
+    template<typename Functor,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<Functor>::type, task_function>::value>::type>
+    task_function(Functor&& functor)
+    : task_function{}
+    {
+        typedef typename std::decay<Functor>::type functor_type;
+        if constexpr (fits_inline<functor_type>()) {
+            new (buffer_) functor_type{std::forward<Functor>(functor)};
+            invoke_ = &invoke_inline<functor_type>;
+            manage_ = &manage_inline<functor_type>;
+        } else {
+            void* block = block_pool::instance().allocate(sizeof(functor_type));
+            try {
+                new (block) functor_type{std::forward<Functor>(functor)};
+            } catch (...) {
+                block_pool::instance().deallocate(block, sizeof(functor_type));
+                throw;
+            }
+            *reinterpret_cast<void**>(buffer_) = block;
+            invoke_ = &invoke_pooled<functor_type>;
+            manage_ = &manage_pooled<functor_type>;
+        }
+    }
+
+    task_function(task_function&& other) noexcept
+    : task_function{}
+    {
+        *this = std::move(other);
+    }
+
+    task_function& operator=(task_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.manage_) {
+                other.manage_(operation::move, other.buffer_, buffer_);
+                invoke_ = other.invoke_;
+                manage_ = other.manage_;
+                other.invoke_ = nullptr;
+                other.manage_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    task_function(const task_function&) = delete;
+    task_function& operator=(const task_function&) = delete;
+
+    ~task_function() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return invoke_ != nullptr;
+    }
+
+    void operator()() {
+        invoke_(buffer_);
+    }
+
+private:
+    enum class operation { move, destroy };
+
+    template<typename Functor>
+    static constexpr bool fits_inline() {
+        return sizeof(Functor) <= buffer_size
+            && alignof(Functor) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Functor>::value;
+    }
+
+    template<typename Functor>
+    static void invoke_inline(void* buffer) {
+        (*static_cast<Functor*>(buffer))();
+    }
+
+    // Moves the callable from src to dst (leaving src destroyed) or
+    // destroys the callable in src
+    template<typename Functor>
+    static void manage_inline(operation op, void* src, void* dst) {
+        Functor* functor = static_cast<Functor*>(src);
+        if (op == operation::move)
+            new (dst) Functor{std::move(*functor)};
+        functor->~Functor();
+    }
+
+    template<typename Functor>
+    static void invoke_pooled(void* buffer) {
+        (**static_cast<Functor**>(buffer))();
+    }
+
+    template<typename Functor>
+    static void manage_pooled(operation op, void* src, void* dst) {
+        Functor* functor = *static_cast<Functor**>(src);
+        if (op == operation::move) {
+            *static_cast<Functor**>(dst) = functor;
+            return;
+        }
+        functor->~Functor();
+        block_pool::instance().deallocate(functor, sizeof(Functor));
+    }
+
+    void reset() noexcept {
+        if (manage_)
+            manage_(operation::destroy, buffer_, nullptr);
+        invoke_ = nullptr;
+        manage_ = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char buffer_[buffer_size];
+    void (*invoke_)(void*);
+    void (*manage_)(operation, void*, void*);
+};
+
+
+// A queued task: its callback, priority and a sequence number that keeps
+// tasks of equal priority in FIFO order. 2^64 pushes never wrap around.
+class priority_task {
+public:
+
+    priority_task(task_function callback, std::size_t priority, std::uint64_t order)
+    : callback_{std::move(callback)}, priority_(priority), order_{order}
     {}
 
     bool operator<(const priority_task& other) const {
@@ -170,14 +366,214 @@ public:
         }
     }
 
-    void operator()() const {
-        return callback_();
+    task_function& callback() {
+        return callback_;
     }
 
 private:
-    std::function<void()> callback_;
+    task_function callback_;
     std::size_t priority_;
-    cxxpool::detail::infinite_counter<counter_elem_t> order_;
+    std::uint64_t order_;
+};
+
+
+// Priority queue of tasks whose nodes come from a slab: chunks of nodes
+// allocated on growth and recycled through a free list, so pushing and
+// popping allocate nothing once the queue has seen its peak size. Not
+// thread-safe, the owner locks around it.
+class task_queue {
+public:
+    static constexpr std::size_t chunk_nodes = 256;
+
+    task_queue()
+    : heap_{}, chunks_{}, free_{nullptr}, counter_{0}
+    {}
+
+    task_queue(const task_queue&) = delete;
+    task_queue& operator=(const task_queue&) = delete;
+
+    ~task_queue() {
+        clear();
+    }
+
+    void push(task_function callback, std::size_t priority) {
+        node* slot = acquire();
+        new (&slot->storage) priority_task{std::move(callback), priority, ++counter_};
+        try {
+            heap_.push_back(slot);
+        } catch (...) {
+            release(slot);
+            throw;
+        }
+        std::push_heap(heap_.begin(), heap_.end(), node_less{});
+    }
+
+    // Moves the callback of the top task out and frees its node
+    bool pop(task_function& callback) {
+        if (heap_.empty())
+            return false;
+        std::pop_heap(heap_.begin(), heap_.end(), node_less{});
+        node* slot = heap_.back();
+        heap_.pop_back();
+        callback = std::move(slot->task().callback());
+        release(slot);
+        return true;
+    }
+
+    std::size_t size() const {
+        return heap_.size();
+    }
+
+    bool empty() const {
+        return heap_.empty();
+    }
+
+    void clear() {
+        for (node* slot : heap_)
+            release(slot);
+        heap_.clear();
+    }
+
+private:
+    union node {
+        node* next;
+        alignas(priority_task) unsigned char storage[sizeof(priority_task)];
+
+        priority_task& task() {
+            return *reinterpret_cast<priority_task*>(&storage);
+        }
+    };
+
+    struct node_less {
+        bool operator()(node* a, node* b) const {
+            return a->task() < b->task();
+        }
+    };
+
+    node* acquire() {
+        if (!free_) {
+            chunks_.emplace_back(new node[chunk_nodes]);
+            node* chunk = chunks_.back().get();
+            for (std::size_t i = 0; i < chunk_nodes; ++i) {
+                chunk[i].next = free_;
+                free_ = &chunk[i];
+            }
+        }
+        node* slot = free_;
+        free_ = slot->next;
+        return slot;
+    }
+
+    void release(node* slot) {
+        slot->task().~priority_task();
+        slot->next = free_;
+        free_ = slot;
+    }
+
+    std::vector<node*> heap_;
+    std::vector<std::unique_ptr<node[]>> chunks_;
+    node* free_;
+    std::uint64_t counter_;
+};
+
+
+// Runs functor with the arguments of a tuple and fulfils promise with the
+// result or the exception thrown
+template<typename R, typename Functor, typename Tuple>
+void fulfil(std::promise<R>& promise, Functor& functor, Tuple& args) {
+    try {
+        if constexpr (std::is_void<R>::value) {
+            std::apply(functor, args);
+            promise.set_value();
+        } else {
+            promise.set_value(std::apply(functor, args));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+
+// State shared by all tasks of one bulk push: the functor, the number of
+// unfinished tasks and the promise behind the aggregate future. The task
+// that finishes last fulfils the promise and destroys the state. Tasks only
+// hold a raw pointer to it, so they are stored inline in task_function.
+template<typename Functor>
+class bulk_state {
+public:
+
+    static bulk_state* create(Functor functor, std::size_t n_tasks) {
+        void* block = block_pool::instance().allocate(sizeof(bulk_state));
+        try {
+            return new (block) bulk_state{std::move(functor), n_tasks};
+        } catch (...) {
+            block_pool::instance().deallocate(block, sizeof(bulk_state));
+            throw;
+        }
+    }
+
+    std::future<void> get_future() {
+        return promise_.get_future();
+    }
+
+    template<typename Arg>
+    void run(Arg&& arg) {
+        try {
+            functor_(std::forward<Arg>(arg));
+        } catch (...) {
+            std::lock_guard<std::mutex> error_lock(error_mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+        release(1);
+    }
+
+    // Marks n_tasks tasks as finished (or never queued)
+    void release(std::size_t n_tasks) {
+        if (remaining_.fetch_sub(n_tasks, std::memory_order_acq_rel) != n_tasks)
+            return;
+        if (error_)
+            promise_.set_exception(error_);
+        else
+            promise_.set_value();
+        this->~bulk_state();
+        block_pool::instance().deallocate(this, sizeof(bulk_state));
+    }
+
+private:
+
+    bulk_state(Functor functor, std::size_t n_tasks)
+    : functor_{std::move(functor)}, remaining_{n_tasks}, error_{},
+      error_mutex_{}, promise_{make_pool_promise<void>()}
+    {}
+
+    Functor functor_;
+    std::atomic<std::size_t> remaining_;
+    std::exception_ptr error_;
+    std::mutex error_mutex_;
+    std::promise<void> promise_;
+};
+
+
+// Calls functor(i) for every i of the chunk [first, last)
+template<typename Index, typename Functor>
+class chunk_functor {
+public:
+
+    chunk_functor(Functor functor, Index end, Index grain)
+    : functor_{std::move(functor)}, end_{end}, grain_{grain}
+    {}
+
+    void operator()(Index first) {
+        const Index last = end_ - first > grain_ ? first + grain_ : end_;
+        for (Index i = first; i < last; ++i)
+            functor_(i);
+    }
+
+private:
+    Functor functor_;
+    Index end_;
+    Index grain_;
 };
 
 
@@ -193,6 +589,30 @@ public:
 };
 
 
+// How the workers of a thread_pool find their tasks
+enum class queue_mode {
+    // One priority queue shared by all workers
+    global,
+    // One priority queue per worker, idle workers steal from the others.
+    // Priorities and FIFO order are strict within a worker's queue but
+    // only approximate across workers
+    work_stealing,
+};
+
+
+namespace detail {
+
+
+// Task queue of one worker in queue_mode::work_stealing
+struct local_queue {
+    std::mutex mutex;
+    cxxpool::detail::task_queue tasks;
+};
+
+
+} // detail
+
+
 // A thread pool for C++
 //
 // Constructing the thread pool launches the worker threads while
@@ -205,27 +625,44 @@ public:
 // Those tasks are processed first that have the highest priority.
 // If priorities are equal those tasks are processed first that were pushed
 // first into the pool (FIFO).
+//
+// Whole ranges of tasks can be pushed with push_bulk() and parallel_for(),
+// which take the task lock once and return one future for all the tasks.
+//
+// With queue_mode::work_stealing every worker has its own queue. Tasks
+// pushed by a worker go to its own queue, others are spread round-robin
+// (bulk pushes in contiguous blocks, one lock per queue). The single
+// task_mutex_ is then only taken by workers going to sleep and by pushes
+// waking them.
 class thread_pool {
 public:
 
     // Constructor. No threads are launched
     thread_pool()
-    : done_{false}, paused_{false}, threads_{}, tasks_{}, task_counter_{},
-      task_cond_var_{}, task_mutex_{}, thread_mutex_{}
+    : done_{false}, paused_{false}, mode_{queue_mode::global}, threads_{},
+      tasks_{}, queues_{}, n_queued_{0}, n_idle_{0},
+      next_queue_{0}, task_cond_var_{}, task_mutex_{}, thread_mutex_{}
     {}
 
     // Constructor. Launches the desired number of threads. Passing 0 is
     // equivalent to calling the no-argument constructor
-    explicit thread_pool(std::size_t n_threads)
+    explicit thread_pool(std::size_t n_threads, queue_mode mode = queue_mode::global)
     : thread_pool{}
     {
+        mode_ = mode;
+        if (mode_ == queue_mode::work_stealing) {
+            if (n_threads == 0)
+                throw thread_pool_error{"work_stealing mode needs at least one thread"};
+            for (std::size_t i = 0; i < n_threads; ++i)
+                queues_.emplace_back(new cxxpool::detail::local_queue);
+        }
         if (n_threads > 0) {
             std::lock_guard<std::mutex> thread_lock(thread_mutex_);
             const auto n_target = threads_.size() + n_threads;
             while (threads_.size() < n_target) {
                 std::thread thread;
                 try {
-                    thread = std::thread{&thread_pool::worker, this};
+                    thread = std::thread{&thread_pool::worker, this, threads_.size()};
                 } catch (...) {
                     shutdown();
                     throw;
@@ -253,9 +690,12 @@ public:
     thread_pool(thread_pool&&) = delete;
     thread_pool& operator=(thread_pool&&) = delete;
 
-    // Adds new threads to the pool and launches them
+    // Adds new threads to the pool and launches them. Not supported in
+    // queue_mode::work_stealing, whose queues are fixed at construction
     void add_threads(std::size_t n_threads) {
         if (n_threads > 0) {
+            if (mode_ == queue_mode::work_stealing)
+                throw thread_pool_error{"add_threads called on a work_stealing pool"};
             {
                 std::lock_guard<std::mutex> task_lock(task_mutex_);
                 if (done_)
@@ -264,7 +704,7 @@ public:
             std::lock_guard<std::mutex> thread_lock(thread_mutex_);
             const auto n_target = threads_.size() + n_threads;
             while (threads_.size() < n_target) {
-                std::thread thread(&thread_pool::worker, this);
+                std::thread thread(&thread_pool::worker, this, threads_.size());
                 try {
                     threads_.push_back(std::move(thread));
                 } catch (...) {
@@ -287,6 +727,11 @@ public:
         return threads_.size();
     }
 
+    // Returns how the workers find their tasks
+    queue_mode mode() const {
+        return mode_;
+    }
+
     // Pushes a new task into the thread pool and returns the associated future.
     // The task will have a priority of 0
     template<typename Functor, typename... Args>
@@ -299,30 +744,104 @@ public:
     template<typename Functor, typename... Args>
     auto push(std::size_t priority, Functor&& functor, Args&&... args) -> std::future<decltype(functor(args...))> {
         typedef decltype(functor(args...)) result_type;
-        auto pack_task = std::make_shared<std::packaged_task<result_type()>>(
-                std::bind(std::forward<Functor>(functor), std::forward<Args>(args)...));
-        auto future = pack_task->get_future();
-        {
-            std::lock_guard<std::mutex> task_lock(task_mutex_);
-            if (done_)
-                throw cxxpool::thread_pool_error{"push called while pool is shutting down"};
-            tasks_.emplace([pack_task]{ (*pack_task)(); }, priority, ++task_counter_);
+        auto promise = cxxpool::detail::make_pool_promise<result_type>();
+        auto future = promise.get_future();
+        // Arguments are stored by value, std::ref ones as references
+        auto task = [functor = std::forward<Functor>(functor), args = std::make_tuple(std::forward<Args>(args)...),
+                     promise = std::move(promise)]() mutable {
+            cxxpool::detail::fulfil(promise, functor, args);
+        };
+        std::size_t n_pushed = 0;
+        push_tasks(priority, 1, [&task]{ return std::move(task); },
+                   "push called while pool is shutting down", n_pushed);
+        return future;
+    }
+
+    // Pushes one task per element of [first, last), each calling
+    // functor(*it), in one locked operation. The tasks have a priority of 0.
+    // Returns a single future that becomes ready once all tasks finished and
+    // holds the first exception thrown by any of them
+    template<typename Iterator, typename Functor>
+    std::future<void> push_bulk(Iterator first, Iterator last, Functor&& functor) {
+        return push_bulk(0, first, last, std::forward<Functor>(functor));
+    }
+
+    // Like push_bulk above, with a given priority for all tasks
+    template<typename Iterator, typename Functor>
+    std::future<void> push_bulk(std::size_t priority, Iterator first, Iterator last, Functor&& functor) {
+        typedef cxxpool::detail::bulk_state<typename std::decay<Functor>::type> state_type;
+        const auto n_tasks = static_cast<std::size_t>(std::distance(first, last));
+        if (n_tasks == 0)
+            return ready_future();
+        auto state = state_type::create(std::forward<Functor>(functor), n_tasks);
+        auto future = state->get_future();
+        std::size_t n_pushed = 0;
+        try {
+            push_tasks(priority, n_tasks, [state, &first]{
+                const Iterator element = first++;
+                return [state, element]{ state->run(*element); };
+            }, "push_bulk called while pool is shutting down", n_pushed);
+        } catch (...) {
+            state->release(n_tasks - n_pushed);
+            throw;
+        }
+        return future;
+    }
+
+    // Calls functor(i) for every i of [begin, end). The range is split into
+    // chunks of grain indices, pushed as tasks of priority 0 in one locked
+    // operation. Returns a single future as push_bulk does
+    template<typename Index, typename Functor>
+    std::future<void> parallel_for(Index begin, Index end, Index grain, Functor&& functor) {
+        return parallel_for(0, begin, end, grain, std::forward<Functor>(functor));
+    }
+
+    // Like parallel_for above, with a given priority for all tasks
+    template<typename Index, typename Functor>
+    std::future<void> parallel_for(std::size_t priority, Index begin, Index end, Index grain, Functor&& functor) {
+        typedef cxxpool::detail::chunk_functor<Index, typename std::decay<Functor>::type> chunk_type;
+        typedef cxxpool::detail::bulk_state<chunk_type> state_type;
+        if (begin >= end)
+            return ready_future();
+        grain = std::max(grain, Index{1});
+        const auto n_tasks = static_cast<std::size_t>((end - begin - 1) / grain + 1);
+        auto state = state_type::create(chunk_type{std::forward<Functor>(functor), end, grain}, n_tasks);
+        auto future = state->get_future();
+        std::size_t n_pushed = 0;
+        try {
+            Index next_first = begin;
+            push_tasks(priority, n_tasks, [state, &next_first, grain]{
+                const Index first = next_first;
+                next_first += grain;
+                return [state, first]{ state->run(first); };
+            }, "parallel_for called while pool is shutting down", n_pushed);
+        } catch (...) {
+            state->release(n_tasks - n_pushed);
+            throw;
         }
-        task_cond_var_.notify_one();
         return future;
     }
 
     // Returns the current number of queued tasks
     std::size_t n_tasks() const {
+        if (mode_ == queue_mode::work_stealing)
+            return n_queued_.load();
         std::lock_guard<std::mutex> task_lock(task_mutex_);
         return tasks_.size();
     }
 
     // Clears all queued tasks, not affecting currently running tasks
     void clear() {
+        if (mode_ == queue_mode::work_stealing) {
+            for (auto& queue : queues_) {
+                std::lock_guard<std::mutex> queue_lock(queue->mutex);
+                n_queued_ -= queue->tasks.size();
+                queue->tasks.clear();
+            }
+            return;
+        }
         std::lock_guard<std::mutex> task_lock(task_mutex_);
-        decltype(tasks_) empty;
-        tasks_.swap(empty);
+        tasks_.clear();
     }
 
     // If enabled then pauses the processing of tasks, not affecting currently
@@ -338,9 +857,91 @@ public:
 
 private:
 
-    void worker() {
+    // The pool and the index of the worker running on this thread, if any
+    struct worker_slot {
+        const thread_pool* pool;
+        std::size_t index;
+    };
+
+    static worker_slot& current_worker() {
+        static thread_local worker_slot slot{nullptr, 0};
+        return slot;
+    }
+
+    static std::future<void> ready_future() {
+        auto promise = cxxpool::detail::make_pool_promise<void>();
+        promise.set_value();
+        return promise.get_future();
+    }
+
+    // Queues n_tasks tasks, next() returning the callback of each in turn.
+    // n_pushed counts the tasks queued so far, also if an exception is
+    // thrown midway
+    template<typename Next>
+    void push_tasks(std::size_t priority, std::size_t n_tasks, Next next,
+                    const char* shutdown_message, std::size_t& n_pushed) {
+        if (mode_ == queue_mode::global) {
+            {
+                std::lock_guard<std::mutex> task_lock(task_mutex_);
+                if (done_)
+                    throw cxxpool::thread_pool_error{shutdown_message};
+                for (; n_pushed < n_tasks; ++n_pushed)
+                    tasks_.push(next(), priority);
+            }
+            if (n_tasks == 1)
+                task_cond_var_.notify_one();
+            else
+                task_cond_var_.notify_all();
+            return;
+        }
+
+        if (done_)
+            throw cxxpool::thread_pool_error{shutdown_message};
+        const std::size_t n_queues = queues_.size();
+        const worker_slot& self = current_worker();
+        const bool own = self.pool == this;
+        const std::size_t first_queue = own ? self.index : next_queue_.fetch_add(1, std::memory_order_relaxed);
+        const std::size_t n_blocks = own ? 1 : std::min(n_tasks, n_queues);
+        try {
+            for (std::size_t block = 0; block < n_blocks; ++block) {
+                auto& queue = *queues_[(first_queue + block) % n_queues];
+                const std::size_t block_end = n_tasks * (block + 1) / n_blocks;
+                std::lock_guard<std::mutex> queue_lock(queue.mutex);
+                for (; n_pushed < block_end; ++n_pushed) {
+                    queue.tasks.push(next(), priority);
+                    n_queued_.fetch_add(1);
+                }
+            }
+        } catch (...) {
+            wake_workers(n_pushed);
+            throw;
+        }
+        wake_workers(n_tasks);
+    }
+
+    // Wakes sleeping workers after n_tasks were queued (work_stealing only).
+    // Pairs with the sleep in worker(): either the pusher sees the
+    // worker's n_idle_ increment or the worker sees the new n_queued_
+    void wake_workers(std::size_t n_tasks) {
+        if (n_tasks == 0 || n_idle_.load() == 0)
+            return;
+        {
+            // The worker checked n_queued_ under this lock before sleeping
+            std::lock_guard<std::mutex> task_lock(task_mutex_);
+        }
+        if (n_tasks == 1)
+            task_cond_var_.notify_one();
+        else
+            task_cond_var_.notify_all();
+    }
+
+    void worker(std::size_t index) {
+        if (mode_ == queue_mode::work_stealing) {
+            worker_stealing(index);
+            return;
+        }
         for (;;) {
-            cxxpool::detail::priority_task task;
+            cxxpool::detail::task_function task;
             {
                 std::unique_lock<std::mutex> task_lock(task_mutex_);
                 task_cond_var_.wait(task_lock, [this]{
@@ -348,13 +949,50 @@ private:
                 });
                 if (done_ && tasks_.empty())
                     break;
-                task = tasks_.top();
-                tasks_.pop();
+                tasks_.pop(task);
             }
             task();
         }
     }
 
+    void worker_stealing(std::size_t index) {
+        current_worker() = worker_slot{this, index};
+        for (;;) {
+            cxxpool::detail::task_function task;
+            if (!paused_ && (pop_task(index, task) || steal_task(index, task))) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> task_lock(task_mutex_);
+            n_idle_.fetch_add(1);
+            task_cond_var_.wait(task_lock, [this]{
+                return !paused_ && (done_ || n_queued_.load() > 0);
+            });
+            n_idle_.fetch_sub(1);
+            if (done_ && n_queued_.load() == 0)
+                break;
+        }
+        current_worker() = worker_slot{nullptr, 0};
+    }
+
+    bool pop_task(std::size_t index, cxxpool::detail::task_function& task) {
+        auto& queue = *queues_[index];
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        if (!queue.tasks.pop(task))
+            return false;
+        n_queued_.fetch_sub(1);
+        return true;
+    }
+
+    // Takes the highest priority task of the first other queue that has one
+    bool steal_task(std::size_t index, cxxpool::detail::task_function& task) {
+        for (std::size_t i = 1; i < queues_.size(); ++i) {
+            if (pop_task((index + i) % queues_.size(), task))
+                return true;
+        }
+        return false;
+    }
+
     void shutdown() {
         {
             std::lock_guard<std::mutex> task_lock(task_mutex_);
@@ -367,12 +1005,16 @@ private:
             thread.join();
     }
 
-    bool done_;
-    bool paused_;
+    // Written under task_mutex_, read without it by work_stealing pools
+    std::atomic<bool> done_;
+    std::atomic<bool> paused_;
+    queue_mode mode_;
     std::vector<std::thread> threads_;
-    std::priority_queue<cxxpool::detail::priority_task> tasks_;
-    cxxpool::detail::infinite_counter<
-    typename detail::priority_task::counter_elem_t> task_counter_;
+    cxxpool::detail::task_queue tasks_;
+    std::vector<std::unique_ptr<cxxpool::detail::local_queue>> queues_;
+    std::atomic<std::size_t> n_queued_;
+    std::atomic<std::size_t> n_idle_;
+    std::atomic<std::size_t> next_queue_;
     std::condition_variable task_cond_var_;
     mutable std::mutex task_mutex_;
     mutable std::mutex thread_mutex_;
@@ -0,0 +1,104 @@
+#ifndef LIMBFORMAT_HPP
+#define LIMBFORMAT_HPP
+
+#include <assert.h>
+#include <cstdint>
+#include <cstring>
+
+#include "lib/infint/InfInt.h"
+
+// Contest inputs serialised into one flat buffer, which other processes
+// map and read without parsing and without a length limit:
+//
+//   uint64_t count
+//   uint64_t offsets[count]      from the buffer start, 8-byte aligned
+//   for every number:
+//     uint32_t limbCount
+//     uint32_t reserved (0)
+//     ELEM_TYPE limbs[limbCount] InfInt limbs, base 10^9, least significant first
+//
+// Only non-negative numbers can be serialised.
+
+inline size_t serializedNumberBytes(const InfInt &n) {
+    return (2 * sizeof(uint32_t) + n.limbCount() * sizeof(ELEM_TYPE) + 7) & ~(size_t) 7;
+}
+
+inline size_t serializedInputsBytes(const InfInt *in, size_t count) {
+    size_t bytes = sizeof(uint64_t) * (count + 1);
+    for (size_t i = 0; i < count; ++i)
+        bytes += serializedNumberBytes(in[i]);
+    return bytes;
+}
+
+// out has to hold serializedInputsBytes(in, count) bytes, 8-byte aligned.
+inline void serializeInputs(const InfInt *in, size_t count, void *out) {
+    char *base = static_cast<char*>(out);
+    uint64_t *header = reinterpret_cast<uint64_t*>(base);
+    header[0] = count;
+    size_t offset = sizeof(uint64_t) * (count + 1);
+    for (size_t i = 0; i < count; ++i) {
+        assert(in[i] >= 0);
+        header[1 + i] = offset;
+        uint32_t *record = reinterpret_cast<uint32_t*>(base + offset);
+        record[0] = (uint32_t) in[i].limbCount();
+        record[1] = 0;
+        std::memcpy(record + 2, in[i].limbData(), in[i].limbCount() * sizeof(ELEM_TYPE));
+        offset += serializedNumberBytes(in[i]);
+    }
+}
+
+// Whether the bytes at data (8-byte aligned) are a well-formed buffer of
+// serializeInputs holding only positive numbers, for buffers that come
+// from outside, such as collatz_service requests.
+inline bool validSerializedInputs(const void *data, size_t bytes) {
+    const char *base = static_cast<const char*>(data);
+    const uint64_t *header = reinterpret_cast<const uint64_t*>(base);
+    if (bytes < sizeof(uint64_t) || header[0] > bytes / sizeof(uint64_t) - 1)
+        return false;
+    size_t count = header[0];
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t offset = header[1 + i];
+        if (offset % 8 != 0 || offset < sizeof(uint64_t) * (count + 1) || offset > bytes - 2 * sizeof(uint32_t))
+            return false;
+        const uint32_t *record = reinterpret_cast<const uint32_t*>(base + offset);
+        size_t limbCount = record[0];
+        if (limbCount == 0 || limbCount > (bytes - offset - 2 * sizeof(uint32_t)) / sizeof(ELEM_TYPE))
+            return false;
+        const ELEM_TYPE *limbs = reinterpret_cast<const ELEM_TYPE*>(record + 2);
+        for (size_t j = 0; j < limbCount; ++j) {
+            if (limbs[j] < 0 || limbs[j] >= BASE)
+                return false;
+        }
+        if (limbs[limbCount - 1] == 0)
+            return false;
+    }
+    return true;
+}
+
+// Read-only view of a buffer written by serializeInputs.
+class SerializedInputs {
+public:
+    explicit SerializedInputs(const void *data): base(static_cast<const char*>(data)) {}
+
+    size_t size() const { return header()[0]; }
+
+    size_t limbCount(size_t i) const { return record(i)[0]; }
+
+    const ELEM_TYPE *limbs(size_t i) const {
+        return reinterpret_cast<const ELEM_TYPE*>(record(i) + 2);
+    }
+
+    InfInt operator[](size_t i) const { return InfInt::fromLimbs(limbs(i), limbCount(i)); }
+
+private:
+    const uint64_t *header() const { return reinterpret_cast<const uint64_t*>(base); }
+
+    const uint32_t *record(size_t i) const {
+        assert(i < size());
+        return reinterpret_cast<const uint32_t*>(base + header()[1 + i]);
+    }
+
+    const char *base;
+};
+
+#endif // LIMBFORMAT_HPP
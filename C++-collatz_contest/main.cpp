@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 
 #include "lib/infint/InfInt.h"
@@ -7,10 +9,40 @@
 #include "generators.hpp"
 #include "teams.hpp"
 #include "contest.hpp"
+#include "collatz.hpp"
+#include "collatzbatch.hpp"
 #include <unistd.h>
 #include <sys/wait.h>
 #include <cstring>
 
+// Every kernel mode has to agree with the plain scalar kernel.
+static void checkKernels(const std::vector<std::shared_ptr<ContestGenerator>> &generators) {
+    std::vector<CollatzLanesFun> lanesFuns = {collatzLanesScalar};
+    if (__builtin_cpu_supports("avx2"))
+        lanesFuns.push_back(collatzLanesAvx2);
+    if (__builtin_cpu_supports("avx512f"))
+        lanesFuns.push_back(collatzLanesAvx512);
+
+    for (auto generator : generators) {
+        for (uint32_t contestId : {2, 5, 23}) {
+            ContestInput contest = generator->getContest(contestId);
+            ContestResult expected;
+            for (InfInt const & in : contest) {
+                expected.push_back(calcCollatzTiered<ScalarSteps>(in));
+                assert(calcCollatzTiered<JumpSteps<8>>(in) == expected.back());
+                assert(calcCollatzTiered<JumpSteps<12>>(in) == expected.back());
+                assert(calcCollatzTiered<JumpSteps<16>>(in) == expected.back());
+            }
+
+            for (CollatzLanesFun lanesFun : lanesFuns) {
+                ContestResult batch(contest.size());
+                calcCollatzBatch(contest.data(), contest.size(), batch.data(), lanesFun);
+                assert(batch == expected);
+            }
+        }
+    }
+}
+
 int main(int argc, char ** argv) {
 
     rtimers::cxx11::DefaultTimer totalTimer("Total");
@@ -22,27 +54,59 @@ int main(int argc, char ** argv) {
         std::shared_ptr<ContestGenerator>(new LongNumberContestGenerator{}),
     };
 
-    std::vector<std::shared_ptr<Team>> teams;
-    teams.push_back(std::shared_ptr<Team>(new TeamSolo{1}));
+    checkKernels(generators);
+
+    // Teams are made only while they are measured: pools keep their threads,
+    // and with every team's threads alive each fork gets slow.
+    typedef std::function<std::shared_ptr<Team>()> MakeTeam;
+    std::vector<MakeTeam> makeTeams;
+    makeTeams.push_back([]() { return std::shared_ptr<Team>(new TeamSolo{1}); });
 
     for (bool share : {false, true}) {
         for (uint32_t numWorkers : {1,2,3,4,7,10}) {
-            teams.push_back(std::shared_ptr<Team>(new TeamNewThreads{numWorkers, share}));
-            teams.push_back(std::shared_ptr<Team>(new TeamConstThreads{numWorkers, share}));
-            teams.push_back(std::shared_ptr<Team>(new TeamPool{numWorkers, share}));
-            // Brak drużyn procesowych X.
-            if (!share) {
-                teams.push_back(std::shared_ptr<Team>(new TeamNewProcesses{numWorkers, share}));
-                teams.push_back(std::shared_ptr<Team>(new TeamConstProcesses{numWorkers, share}));
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamNewThreads{numWorkers, share}); });
+            for (SchedulePolicy policy : {SchedulePolicy::Static, SchedulePolicy::FixedChunk,
+                                          SchedulePolicy::Guided, SchedulePolicy::CostAware}) {
+                Schedule schedule;
+                schedule.policy = policy;
+                makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamConstThreads{numWorkers, share, schedule}); });
+                makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamPool{numWorkers, share, schedule}); });
             }
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamWorkStealing{numWorkers, share}); });
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamCoroutine{numWorkers, share}); });
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamNewProcesses{numWorkers, share}); });
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamConstProcesses{numWorkers, share}); });
+            makeTeams.push_back([=]() {
+                return std::shared_ptr<Team>(new TeamConstProcesses{numWorkers, share, Partitioning::Lpt});
+            });
+            // new_process shares no results, the X run would only repeat it.
+            if (!share)
+                makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamExecProcesses{numWorkers, share}); });
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamProcessPool{numWorkers, share}); });
         }
-        teams.push_back(std::shared_ptr<Team>(new TeamAsync{1, share}));
+        for (AffinityPolicy policy : {AffinityPolicy::Compact, AffinityPolicy::Scatter}) {
+            Affinity affinity;
+            affinity.policy = policy;
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamConstThreads{4, share, Schedule{}, affinity}); });
+            makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamPool{4, share, Schedule{}, affinity}); });
+            makeTeams.push_back([=]() {
+                return std::shared_ptr<Team>(new TeamConstProcesses{4, share, Partitioning::Contiguous, affinity});
+            });
+        }
+        makeTeams.push_back([=]() { return std::shared_ptr<Team>(new TeamAsync{1, share}); });
     }
 
-    for (auto generator : generators) {
-        for (uint32_t contestId : {2, 5, 23}) {
-            std::shared_ptr<ContestResult> expectedResult;
-            for (auto team : teams) {
+    const std::vector<uint32_t> contestIds = {2, 5, 23};
+    // The first team (TeamSolo) sets the expected result of every contest.
+    std::vector<std::shared_ptr<ContestResult>> expectedResults(generators.size() * contestIds.size());
+
+    for (auto makeTeam : makeTeams) {
+        std::shared_ptr<Team> team = makeTeam();
+        for (size_t g = 0; g < generators.size(); ++g) {
+            auto generator = generators[g];
+            for (size_t c = 0; c < contestIds.size(); ++c) {
+                uint32_t contestId = contestIds[c];
+                std::shared_ptr<ContestResult> &expectedResult = expectedResults[g * contestIds.size() + c];
                 std::string contestName = generator->getContestName(contestId);
                 ContestResult lastResult;
                 rtimers::cxx11::DefaultTimer timer( team->getTeamName() + contestName);
@@ -58,6 +122,16 @@ int main(int argc, char ** argv) {
                     expectedResult.reset(new ContestResult{});
                     *expectedResult = lastResult;
                 }
+
+                // Streamed, every element has to come exactly once, with its result.
+                std::vector<bool> streamed(lastResult.size(), false);
+                ContestResult streamedResult = team->runContestStreaming(generator->getContest(contestId),
+                    [&](size_t i, uint64_t steps) {
+                        assert(i < streamed.size() && !streamed[i] && steps == lastResult[i]);
+                        streamed[i] = true;
+                    });
+                assert(streamedResult == lastResult);
+                assert(std::count(streamed.begin(), streamed.end(), false) == 0);
             }
         }
     }
@@ -0,0 +1,48 @@
+#ifndef MAPPEDARRAY_HPP
+#define MAPPEDARRAY_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <sys/mman.h>
+
+// Fixed-size array of atomics (or structs of them) in anonymous memory,
+// starting out as all zero bits. Pages are only backed once touched, so a
+// big, mostly empty table costs neither memory nor time in fork(), and
+// each page lands on the NUMA node of the thread that first writes it.
+template<typename T>
+class MappedArray {
+public:
+    static_assert(std::is_standard_layout<T>::value, "elements are mapped as plain memory");
+
+    explicit MappedArray(size_t sizeArg): size(sizeArg), items(nullptr) {
+        if (size == 0)
+            return;
+        void *mapped = mmap(nullptr, bytes(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+        items = static_cast<T*>(mapped);
+    }
+
+    MappedArray(const MappedArray&) = delete;
+    MappedArray& operator=(const MappedArray&) = delete;
+
+    ~MappedArray() {
+        if (items != nullptr)
+            munmap(items, bytes());
+    }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+
+    T *get() { return items; }
+    const T *get() const { return items; }
+
+private:
+    size_t bytes() const { return size * sizeof(T); }
+
+    const size_t size;
+    T *items;
+};
+
+#endif // MAPPEDARRAY_HPP
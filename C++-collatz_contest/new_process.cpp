@@ -8,50 +8,70 @@
 #include <cstring>
 
 #include "collatz.hpp"
+#include "collatzbatch.hpp"
+#include "limbformat.hpp"
 
 using ull = unsigned long long;
 
 // Wersja korzystająca z new_process.cpp działa dużo wolniej.
 // Testy procesowe (bez drużyn X) przechodzą wtedy w ok. 30 minuty, zaś w wersji korzystającej z pamięci anonimowej ok. 15 minut.
 // Na samym dole pliku teams.cpp zostawiłem zakomentowane wersje obu drużyn (bez X) korzystające z new_process.cpp.
+//
+// Usage: new_process <begin> <count> [<fd in> <fd out>]
+// SHM_NAME_IN holds the whole contest written by serializeInputs (limbformat.hpp),
+// its size comes from fstat. Results of [begin, begin + count) go to SHM_NAME_OUT,
+// one uint64_t per input. With fd in and fd out the two regions are instead
+// descriptors inherited from the parent (TeamExecProcesses).
 int main(int argc, char *argv[]) {
-    int read_dsc = -1, write_dsc = -1;
+    if (argc != 3 && argc != 5) {
+        std::cerr << "usage: " << argv[0] << " <begin> <count> [<fd in> <fd out>]\n";
+        return 1;
+    }
+    size_t begin = strtoul(argv[1], NULL, 10);
+    size_t my_input_size = strtoul(argv[2], NULL, 10);
 
-    read_dsc = shm_open("/collatz_mem_in", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-    write_dsc = shm_open("/collatz_mem_out", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    int read_dsc = argc == 5 ? atoi(argv[3]) : shm_open(SHM_NAME_IN, O_RDONLY, 0);
     if (read_dsc == -1) {
         printf("read - errno(%d): %s\n", errno, std::strerror(errno));
+        return 1;
     }
+    int write_dsc = argc == 5 ? atoi(argv[4]) : shm_open(SHM_NAME_OUT, O_RDWR, 0);
     if (write_dsc == -1) {
         printf("write - errno(%d): %s\n", errno, std::strerror(errno));
+        return 1;
     }
-    size_t begin = strtoul(argv[1], NULL, 10);
-    size_t my_input_size = strtoul(argv[2], NULL, 10);
-    size_t input_size = strtoul(argv[3], NULL, 10);
 
-    char (*mapped_input)[MAX_INFINT_LEN];
-    uint64_t *mapped_output;
+    struct stat input_stat;
+    if (fstat(read_dsc, &input_stat) == -1) {
+        printf("fstat - errno(%d): %s\n", errno, std::strerror(errno));
+        return 1;
+    }
+    size_t input_bytes = input_stat.st_size;
 
-    int flags, prot;
-    prot = PROT_READ | PROT_WRITE;
-    flags = MAP_SHARED;
-    mapped_input =(char(*)[MAX_INFINT_LEN]) mmap(NULL, input_size * MAX_INFINT_LEN, prot, flags, read_dsc, 0);
+    void *mapped_input = mmap(NULL, input_bytes, PROT_READ, MAP_SHARED, read_dsc, 0);
     if (mapped_input == MAP_FAILED) {
         printf("mmap 1 - errno(%d): %s\n", errno, std::strerror(errno));
+        return 1;
     }
-    mapped_output = (uint64_t*) mmap(NULL, input_size * sizeof(uint64_t), prot, flags, write_dsc, 0);
+    SerializedInputs inputs(mapped_input);
+    size_t input_size = inputs.size();
+    assert(begin + my_input_size <= input_size);
+
+    uint64_t *mapped_output = (uint64_t*) mmap(NULL, input_size * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                                               MAP_SHARED, write_dsc, 0);
     if (mapped_output == MAP_FAILED) {
         printf("mmap 2 - errno(%d): %s\n", errno, std::strerror(errno));
+        return 1;
     }
 
-    for (size_t i = 0; i < my_input_size; ++i) {
-        mapped_output[begin + i] = calcCollatz(mapped_input[begin + i]);
-    }
+    // Limbs are read straight from the mapping, nothing is parsed or copied
+    // but the numbers too big for uint128_t.
+    calcCollatzBatchLimbs(inputs, begin, begin + my_input_size, mapped_output + begin);
 
     close(read_dsc);
     close(write_dsc);
-    munmap(mapped_input, input_size * MAX_INFINT_LEN);
+    munmap(mapped_input, input_bytes);
     munmap(mapped_output, input_size * sizeof(uint64_t));
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,302 @@
+#ifndef PROCESSPOOL_HPP
+#define PROCESSPOOL_HPP
+
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lib/infint/InfInt.h"
+#include "completionqueue.hpp"
+#include "contest.hpp"
+#include "futex.hpp"
+#include "limbformat.hpp"
+
+// Bounded multi-producer multi-consumer ring of 64-bit tasks (Vyukov's
+// queue), meant to be placed in memory shared by processes: it holds no
+// pointers and only lock-free atomics.
+class ShmTaskRing {
+public:
+    static const uint64_t CAPACITY = 1024;
+
+    ShmTaskRing(): enqueuePos(0), dequeuePos(0) {
+        for (uint64_t i = 0; i < CAPACITY; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(uint64_t task) {
+        uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos % CAPACITY];
+            int64_t diff = (int64_t) cell->seq.load(std::memory_order_acquire) - (int64_t) pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->task = task;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(uint64_t &task) {
+        uint64_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos % CAPACITY];
+            int64_t diff = (int64_t) cell->seq.load(std::memory_order_acquire) - (int64_t) (pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        task = cell->task;
+        cell->seq.store(pos + CAPACITY, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> seq;
+        uint64_t task;
+    };
+
+    alignas(64) std::atomic<uint64_t> enqueuePos;
+    alignas(64) std::atomic<uint64_t> dequeuePos;
+    alignas(64) Cell cells[CAPACITY];
+};
+
+// Worker processes forked once and then fed with contests through shared
+// memory, so a contest costs no fork() and no page-table copies.
+//
+// The parent serialises a batch of inputs (limbformat.hpp) into the shared
+// arena and pushes [begin, end) chunks of it to a ShmTaskRing. Workers pop
+// chunks, run work on them, which writes the results into the shared
+// output array, and count finished elements. Both sides sleep on futexes:
+// workers on a sequence bumped whenever tasks come, the parent on the
+// finished count. The parent's wait is timed, so a worker that died is
+// noticed: the batch fails, and so does every later one. The workers die
+// with the parent (with the thread that made the pool, strictly): the
+// kernel kills them, and a worker waiting for tasks also looks now and then
+// whether it was reparented.
+//
+// A streamed run also hands work a CompletionQueue of the batch, made
+// before the fork like the rest of the shared memory, and the parent
+// passes each element on as soon as it is popped from it.
+class ProcessPool {
+public:
+    // Computes out[i] for inputs[i], begin <= i < end, and pushes i to
+    // completed once out[i] is written, unless completed is nullptr.
+    typedef std::function<void(const SerializedInputs &inputs, size_t begin, size_t end, uint64_t *out,
+                               CompletionQueue *completed)> Work;
+
+    static const size_t MAX_BATCH = 1 << 16;
+    static const size_t ARENA_BYTES = 32 << 20;
+    // How often a waiting parent looks for dead workers, and an idle worker
+    // for a dead parent.
+    static const long LIVE_CHECK_NS = 100 * 1000 * 1000;
+
+    ProcessPool(uint32_t workers, Work work): completed(MAX_BATCH), broken(false) {
+        void *mapped = mmap(nullptr, regionBytes(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+        control = new (mapped) Control();
+        output = reinterpret_cast<uint64_t*>(static_cast<char*>(mapped) + sizeof(Control));
+        arena = reinterpret_cast<char*>(output + MAX_BATCH);
+
+        pid_t parent = getpid();
+        for (uint32_t i = 0; i < workers; ++i) {
+            pid_t pid = fork();
+            if (pid == -1) {
+                int error = errno;
+                shutdown();
+                throw std::system_error(error, std::generic_category(), "ProcessPool fork");
+            }
+            if (pid == 0) {
+                // The parent may have died before the signal was asked for.
+                if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1 || getppid() != parent)
+                    _exit(1);
+                workerLoop(work, parent);
+            }
+            pids.push_back(pid);
+        }
+    }
+
+    ProcessPool(const ProcessPool&) = delete;
+    ProcessPool& operator=(const ProcessPool&) = delete;
+
+    ~ProcessPool() { shutdown(); }
+
+    // An empty callback streams nothing.
+    void run(const InfInt *in, size_t count, uint64_t *out, const ResultCallback &callback = ResultCallback{}) {
+        // A failed batch may have left its tasks in the ring.
+        if (broken)
+            throw std::runtime_error("ProcessPool: a worker died");
+        size_t begin = 0;
+        while (begin < count) {
+            size_t batch = batchSize(in + begin, count - begin);
+            runBatch(in + begin, batch, begin, callback);
+            std::memcpy(out + begin, output, batch * sizeof(uint64_t));
+            begin += batch;
+        }
+    }
+
+private:
+    struct Control {
+        // Bumped (and woken) whenever tasks are pushed or the pool stops.
+        std::atomic<uint32_t> wakeSeq{0};
+        // Finished elements of the current batch.
+        std::atomic<uint32_t> done{0};
+        std::atomic<uint32_t> batch{0};
+        std::atomic<uint32_t> stop{0};
+        // Whether the current batch is streamed through completed.
+        std::atomic<uint32_t> streaming{0};
+        ShmTaskRing tasks;
+    };
+
+    static size_t regionBytes() { return sizeof(Control) + MAX_BATCH * sizeof(uint64_t) + ARENA_BYTES; }
+
+    static uint64_t packTask(size_t begin, size_t end) { return (uint64_t) begin << 32 | end; }
+
+    // Number of inputs from in that fit in one batch.
+    static size_t batchSize(const InfInt *in, size_t count) {
+        size_t bytes = sizeof(uint64_t);
+        size_t batch = 0;
+        while (batch < count && batch < MAX_BATCH) {
+            bytes += sizeof(uint64_t) + serializedNumberBytes(in[batch]);
+            if (bytes > ARENA_BYTES)
+                break;
+            ++batch;
+        }
+        if (batch == 0)
+            throw std::length_error("ProcessPool: input does not fit in the arena");
+        return batch;
+    }
+
+    // The batch starts at element offset of the run, for the callback.
+    void runBatch(const InfInt *in, size_t count, size_t offset, const ResultCallback &callback) {
+        serializeInputs(in, count, arena);
+        control->done.store(0, std::memory_order_relaxed);
+        control->batch.store(count, std::memory_order_relaxed);
+        // Published to the workers by the release of the pushes below.
+        control->streaming.store(callback ? 1 : 0, std::memory_order_relaxed);
+        if (callback)
+            completed.reset();
+
+        // A few chunks per worker, but never more than the ring holds.
+        size_t chunk = std::max(count / (4 * pids.size()), (count + ShmTaskRing::CAPACITY - 1) / ShmTaskRing::CAPACITY);
+        chunk = std::max(chunk, (size_t) 1);
+        for (size_t begin = 0; begin < count; begin += chunk) {
+            bool pushed = control->tasks.push(packTask(begin, std::min(begin + chunk, count)));
+            assert(pushed);
+        }
+        control->wakeSeq.fetch_add(1, std::memory_order_release);
+        futexWake(control->wakeSeq, INT_MAX);
+
+        const timespec liveCheck = {0, LIVE_CHECK_NS};
+        if (callback) {
+            for (size_t k = 0; k < count; ++k) {
+                size_t i;
+                while (!completed.popFor(i, liveCheck)) {
+                    if (!workersAlive()) {
+                        broken = true;
+                        throw std::runtime_error("ProcessPool: a worker died");
+                    }
+                }
+                callback(offset + i, output[i]);
+            }
+        }
+
+        // Also when streamed: the workers count an element after pushing
+        // it, and the next batch resets the count.
+        uint32_t done;
+        while ((done = control->done.load(std::memory_order_acquire)) != count) {
+            futexWait(control->done, done, &liveCheck);
+            if (control->done.load(std::memory_order_acquire) != count && !workersAlive()) {
+                broken = true;
+                throw std::runtime_error("ProcessPool: a worker died");
+            }
+        }
+    }
+
+    // Reaps the workers that are gone, false if there were any.
+    bool workersAlive() {
+        size_t alive = 0;
+        for (pid_t pid : pids) {
+            if (waitpid(pid, nullptr, WNOHANG) == 0)
+                pids[alive++] = pid;
+        }
+        bool all = alive == pids.size();
+        pids.resize(alive);
+        return all;
+    }
+
+    [[noreturn]] void workerLoop(const Work &work, pid_t parent) {
+        const timespec liveCheck = {0, LIVE_CHECK_NS};
+        SerializedInputs inputs(arena);
+        while (true) {
+            uint32_t seq = control->wakeSeq.load(std::memory_order_acquire);
+            uint64_t task;
+            if (control->tasks.pop(task)) {
+                size_t begin = task >> 32, end = (uint32_t) task;
+                bool streaming = control->streaming.load(std::memory_order_relaxed);
+                work(inputs, begin, end, output, streaming ? &completed : nullptr);
+                uint32_t finished = end - begin;
+                if (control->done.fetch_add(finished, std::memory_order_acq_rel) + finished ==
+                    control->batch.load(std::memory_order_relaxed))
+                    futexWake(control->done, 1);
+                continue;
+            }
+            if (control->stop.load(std::memory_order_acquire))
+                _exit(0);
+            if (getppid() != parent)
+                _exit(1);
+            futexWait(control->wakeSeq, seq, &liveCheck);
+        }
+    }
+
+    void shutdown() {
+        control->stop.store(1, std::memory_order_release);
+        control->wakeSeq.fetch_add(1, std::memory_order_release);
+        futexWake(control->wakeSeq, INT_MAX);
+        for (pid_t pid : pids)
+            waitpid(pid, nullptr, 0);
+        pids.clear();
+        munmap(control, regionBytes());
+    }
+
+    Control *control;
+    uint64_t *output;
+    char *arena;
+    CompletionQueue completed;
+    std::vector<pid_t> pids;
+    bool broken;
+};
+
+#endif // PROCESSPOOL_HPP
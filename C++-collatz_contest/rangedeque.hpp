@@ -0,0 +1,87 @@
+#ifndef RANGEDEQUE_HPP
+#define RANGEDEQUE_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+
+// Half-open range [begin, end) of contest indices.
+struct IndexRange {
+    uint32_t begin;
+    uint32_t end;
+
+    uint32_t size() const { return end - begin; }
+
+    uint64_t pack() const { return (uint64_t) begin << 32 | end; }
+    static IndexRange unpack(uint64_t packed) { return {(uint32_t) (packed >> 32), (uint32_t) packed}; }
+};
+
+// Chase-Lev work-stealing deque of index ranges, each packed into one
+// 64-bit word (after Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models"). The owner pushes and pops at the bottom, thieves
+// steal from the top, i.e. the oldest and so largest ranges.
+//
+// Ranges are only ever split in halves, so the deque never holds more than
+// about 32 of them and a fixed capacity is enough.
+class RangeDeque {
+public:
+    static const int64_t CAPACITY = 64;
+
+    RangeDeque(): top(0), bottom(0) {
+        for (std::atomic<uint64_t> &slot : slots)
+            slot.store(0, std::memory_order_relaxed);
+    }
+
+    // Owner only. Returns false if the deque is full.
+    bool push(IndexRange range) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+            return false;
+        slots[b % CAPACITY].store(range.pack(), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only.
+    bool pop(IndexRange &range) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        range = IndexRange::unpack(slots[b % CAPACITY].load(std::memory_order_relaxed));
+        if (t == b) {
+            // Last range, race the thieves for it.
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread. Returns false if the deque is empty or another thread won the race.
+    bool steal(IndexRange &range) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return false;
+        uint64_t packed = slots[t % CAPACITY].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return false;
+        range = IndexRange::unpack(packed);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<uint64_t> slots[CAPACITY];
+};
+
+#endif // RANGEDEQUE_HPP
@@ -0,0 +1,382 @@
+#ifndef RESULTCACHE_HPP
+#define RESULTCACHE_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lib/infint/InfInt.h"
+#include "mappedarray.hpp"
+
+// Cached result of one InfInt, immutable except for the eviction metadata.
+struct ResultEntry {
+    InfInt key;
+    size_t hash;
+    uint64_t value;
+    std::atomic<uint32_t> meta;
+
+    ResultEntry(const InfInt &keyArg, size_t hashArg, uint64_t valueArg, uint32_t metaArg):
+        key(keyArg), hash(hashArg), value(valueArg), meta(metaArg) {}
+
+    // Memory charged to the cache for this entry: the key's limbs only add
+    // to it when they don't fit inline in the InfInt.
+    size_t bytes() const {
+        return sizeof(ResultEntry) + (key.limbCount() > INFINT_INLINE_LIMBS ? key.limbCount() * sizeof(ELEM_TYPE) : 0);
+    }
+};
+
+// Marks a slot whose entry was evicted, so that probe sequences stay intact.
+inline ResultEntry *const EVICTED_ENTRY = reinterpret_cast<ResultEntry*>(uintptr_t(1));
+
+// Entry in a slot, or nullptr if it holds none.
+inline ResultEntry *liveEntry(const std::atomic<ResultEntry*> &slot) {
+    ResultEntry *entry = slot.load(std::memory_order_acquire);
+    return entry == EVICTED_ENTRY ? nullptr : entry;
+}
+
+// Decides which entries a bounded cache drops. Hits only update the meta
+// word of an entry; victims are picked under the cache eviction lock, so
+// a policy keeps its own state without synchronisation.
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() {}
+
+    virtual std::string getName() const = 0;
+
+    // Meta word of a freshly inserted entry.
+    virtual uint32_t initialMeta() = 0;
+
+    virtual void onHit(std::atomic<uint32_t> &meta) = 0;
+
+    // Index of a slot holding an entry to evict, there is at least one.
+    virtual size_t pickVictim(const std::atomic<ResultEntry*> *slots, size_t capacity) = 0;
+};
+
+// Second chance: the hand clears reference bits until it finds an entry
+// that was not hit since its last pass.
+class ClockEviction : public EvictionPolicy {
+public:
+    std::string getName() const override { return "Clock"; }
+
+    uint32_t initialMeta() override { return 1; }
+
+    void onHit(std::atomic<uint32_t> &meta) override {
+        // Hot entries are hit by all threads, so avoid writing their line.
+        if (meta.load(std::memory_order_relaxed) == 0)
+            meta.store(1, std::memory_order_relaxed);
+    }
+
+    size_t pickVictim(const std::atomic<ResultEntry*> *slots, size_t capacity) override {
+        while (true) {
+            size_t i = hand++ % capacity;
+            ResultEntry *entry = liveEntry(slots[i]);
+            if (entry == nullptr)
+                continue;
+            if (entry->meta.load(std::memory_order_relaxed) == 0)
+                return i;
+            entry->meta.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    size_t hand = 0;
+};
+
+// Evicts the least frequently used of a few random entries. Counters are
+// logarithmic (a hit increments counter c with probability 1/(c+1)) and
+// are halved whenever an entry survives a sample, so old popularity fades.
+class SampledLfuEviction : public EvictionPolicy {
+public:
+    static const size_t SAMPLES = 8;
+    static const uint32_t MAX_COUNT = 255;
+
+    std::string getName() const override { return "SampledLfu"; }
+
+    uint32_t initialMeta() override { return 1; }
+
+    void onHit(std::atomic<uint32_t> &meta) override {
+        uint32_t count = meta.load(std::memory_order_relaxed);
+        if (count < MAX_COUNT && threadRandom() % (count + 1) == 0)
+            meta.store(count + 1, std::memory_order_relaxed);
+    }
+
+    size_t pickVictim(const std::atomic<ResultEntry*> *slots, size_t capacity) override {
+        size_t victim = capacity;
+        uint32_t victimCount = UINT32_MAX;
+        size_t sampled = 0;
+        while (sampled < SAMPLES || victim == capacity) {
+            size_t i = random() % capacity;
+            ResultEntry *entry = liveEntry(slots[i]);
+            if (entry == nullptr)
+                continue;
+            ++sampled;
+            uint32_t count = entry->meta.load(std::memory_order_relaxed);
+            if (count < victimCount) {
+                victim = i;
+                victimCount = count;
+            }
+            entry->meta.store(count / 2, std::memory_order_relaxed);
+        }
+        return victim;
+    }
+
+private:
+    static uint64_t threadRandom() {
+        thread_local uint64_t state = 0x9e3779b97f4a7c15ULL ^ (uintptr_t) &state;
+        return xorshift(state);
+    }
+
+    uint64_t random() { return xorshift(state); }
+
+    static uint64_t xorshift(uint64_t &x) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+};
+
+enum class EvictionKind { Clock, SampledLfu };
+
+inline std::unique_ptr<EvictionPolicy> makeEvictionPolicy(EvictionKind kind) {
+    switch (kind) {
+        case EvictionKind::SampledLfu:
+            return std::unique_ptr<EvictionPolicy>(new SampledLfuEviction{});
+        case EvictionKind::Clock:
+        default:
+            return std::unique_ptr<EvictionPolicy>(new ClockEviction{});
+    }
+}
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inserts = 0;
+    uint64_t evictions = 0;
+    // Results not stored because their whole probe window was taken.
+    uint64_t rejected = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+
+    double hitRate() const { return hits + misses == 0 ? 0.0 : (double) hits / (hits + misses); }
+};
+
+// Lock-free for readers, bounded cache from InfInt to its result.
+//
+// Slots hold pointers to immutable entries, readers follow a bounded probe
+// window with acquire loads. Writers publish an entry with a CAS on an empty
+// or evicted slot; when the entries take more than maxBytes, the eviction
+// policy picks victims whose slots get marked as evicted. The same happens
+// above maxEntries entries, which keeps the probe windows short.
+//
+// Evicted entries are freed with a two-epoch scheme: a reader announces
+// itself in the counter of the current epoch parity (sharded per thread),
+// and the reclaimer flips the epoch and waits for the old parity to drain
+// before freeing entries unlinked earlier. Only writers ever wait.
+//
+// Duplicate keys are harmless: a key always maps to the same result.
+class InfIntResultCache {
+public:
+    static const size_t MAX_PROBES = 16;
+    static const size_t READER_SHARDS = 64;
+    static const size_t RECLAIM_BATCH = 256;
+
+    InfIntResultCache(size_t maxEntriesArg, size_t maxBytesArg, std::unique_ptr<EvictionPolicy> evictionArg):
+        capacity(slotCount(maxEntriesArg)), maxEntries(maxEntriesArg), maxBytes(maxBytesArg), eviction(std::move(evictionArg)),
+        slots(capacity), epoch(0), usedBytes(0), entries(0), inserts(0), evictions(0), rejected(0) {
+        assert(eviction);
+    }
+
+    InfIntResultCache(const InfIntResultCache&) = delete;
+    InfIntResultCache& operator=(const InfIntResultCache&) = delete;
+
+    ~InfIntResultCache() {
+        for (size_t i = 0; i < capacity; ++i)
+            delete liveEntry(slots[i]);
+        for (ResultEntry *entry : retired)
+            delete entry;
+    }
+
+    bool find(const InfInt &key, uint64_t &value) {
+        size_t hash = mix(key.hash());
+        ReaderShard &shard = readerShards[threadShard()];
+        uint64_t parity = enter(shard);
+        bool found = false;
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            ResultEntry *entry = slots[(hash + probe) & (capacity - 1)].load(std::memory_order_acquire);
+            if (entry == nullptr)
+                break;
+            if (entry != EVICTED_ENTRY && entry->hash == hash && entry->key == key) {
+                eviction->onHit(entry->meta);
+                value = entry->value;
+                found = true;
+                break;
+            }
+        }
+        shard.readers[parity].fetch_sub(1, std::memory_order_release);
+        (found ? shard.hits : shard.misses).fetch_add(1, std::memory_order_relaxed);
+        return found;
+    }
+
+    void insert(const InfInt &key, uint64_t value) {
+        size_t hash = mix(key.hash());
+        std::unique_ptr<ResultEntry> fresh(new ResultEntry(key, hash, value, eviction->initialMeta()));
+        // Once published, the entry may be evicted and freed at any time.
+        size_t bytes = fresh->bytes();
+        // Comparing keys reads entries, so it needs the same protection as find.
+        ReaderShard &shard = readerShards[threadShard()];
+        uint64_t parity = enter(shard);
+        InsertResult result = tryInsert(fresh.get());
+        shard.readers[parity].fetch_sub(1, std::memory_order_release);
+
+        switch (result) {
+            case Inserted: {
+                fresh.release();
+                inserts.fetch_add(1, std::memory_order_relaxed);
+                size_t count = entries.fetch_add(1, std::memory_order_relaxed) + 1;
+                if (usedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes > maxBytes || count > maxEntries)
+                    evict();
+                break;
+            }
+            case Duplicate:
+                break;
+            case Full:
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                break;
+        }
+    }
+
+    CacheStats getStats() const {
+        CacheStats stats;
+        for (const ReaderShard &shard : readerShards) {
+            stats.hits += shard.hits.load(std::memory_order_relaxed);
+            stats.misses += shard.misses.load(std::memory_order_relaxed);
+        }
+        stats.inserts = inserts.load(std::memory_order_relaxed);
+        stats.evictions = evictions.load(std::memory_order_relaxed);
+        stats.rejected = rejected.load(std::memory_order_relaxed);
+        stats.entries = entries.load(std::memory_order_relaxed);
+        stats.bytes = usedBytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    const EvictionPolicy &getEvictionPolicy() const { return *eviction; }
+
+private:
+    struct alignas(64) ReaderShard {
+        std::atomic<uint64_t> readers[2] = {0, 0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+    };
+
+    enum InsertResult { Inserted, Duplicate, Full };
+
+    InsertResult tryInsert(ResultEntry *fresh) {
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            std::atomic<ResultEntry*> &slot = slots[(fresh->hash + probe) & (capacity - 1)];
+            ResultEntry *current = slot.load(std::memory_order_acquire);
+            if ((current == nullptr || current == EVICTED_ENTRY) &&
+                slot.compare_exchange_strong(current, fresh, std::memory_order_acq_rel))
+                return Inserted;
+            // current is the entry somebody else published in this slot.
+            if (current != nullptr && current != EVICTED_ENTRY && current->hash == fresh->hash &&
+                current->key == fresh->key)
+                return Duplicate;
+        }
+        return Full;
+    }
+
+    // Registers a reader in the current epoch and returns its parity.
+    uint64_t enter(ReaderShard &shard) {
+        while (true) {
+            uint64_t current = epoch.load(std::memory_order_seq_cst);
+            shard.readers[current & 1].fetch_add(1, std::memory_order_seq_cst);
+            // If a reclaimer flipped the epoch in between, it may have seen
+            // the old parity drained already, so register again.
+            if (epoch.load(std::memory_order_seq_cst) == current)
+                return current & 1;
+            shard.readers[current & 1].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void evict() {
+        std::lock_guard<std::mutex> lock(evictMutex);
+        while (overLimit()) {
+            size_t victim = eviction->pickVictim(slots.get(), capacity);
+            ResultEntry *entry = slots[victim].load(std::memory_order_relaxed);
+            // Writers only ever replace empty or evicted slots, so the victim stays put.
+            slots[victim].store(EVICTED_ENTRY, std::memory_order_seq_cst);
+            usedBytes.fetch_sub(entry->bytes(), std::memory_order_relaxed);
+            entries.fetch_sub(1, std::memory_order_relaxed);
+            evictions.fetch_add(1, std::memory_order_relaxed);
+            retired.push_back(entry);
+        }
+        if (retired.size() >= RECLAIM_BATCH)
+            reclaim();
+    }
+
+    bool overLimit() const {
+        size_t count = entries.load(std::memory_order_relaxed);
+        return count > 0 && (count > maxEntries || usedBytes.load(std::memory_order_relaxed) > maxBytes);
+    }
+
+    // Frees the retired entries once no reader can still hold them.
+    void reclaim() {
+        uint64_t old = epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+        for (ReaderShard &shard : readerShards)
+            while (shard.readers[old].load(std::memory_order_seq_cst) != 0)
+                std::this_thread::yield();
+        for (ResultEntry *entry : retired)
+            delete entry;
+        retired.clear();
+    }
+
+    static size_t threadShard() {
+        static std::atomic<size_t> nextThread{0};
+        thread_local size_t thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+        return thread % READER_SHARDS;
+    }
+
+    // Twice as many slots as entries, so probe windows rarely fill up.
+    static size_t slotCount(size_t maxEntries) {
+        size_t count = MAX_PROBES;
+        while (count < 2 * maxEntries)
+            count *= 2;
+        return count;
+    }
+
+    // Finalizer of splitmix64, spreads InfInt::hash over all the bits.
+    static size_t mix(size_t hash) {
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    const size_t capacity;
+    const size_t maxEntries;
+    const size_t maxBytes;
+    const std::unique_ptr<EvictionPolicy> eviction;
+    MappedArray<std::atomic<ResultEntry*>> slots;
+
+    std::atomic<uint64_t> epoch;
+    ReaderShard readerShards[READER_SHARDS];
+
+    std::atomic<size_t> usedBytes;
+    std::atomic<size_t> entries;
+    std::atomic<uint64_t> inserts;
+    std::atomic<uint64_t> evictions;
+    std::atomic<uint64_t> rejected;
+
+    // Guards the eviction policy and retired.
+    std::mutex evictMutex;
+    std::vector<ResultEntry*> retired;
+};
+
+#endif // RESULTCACHE_HPP
@@ -0,0 +1,95 @@
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "contest.hpp"
+#include "costmodel.hpp"
+
+// How the workers of a thread team split a contest.
+enum class SchedulePolicy {
+    // Worker i takes elements i, i + n, i + 2n, ... (the i-th contiguous
+    // slice without shared results or with an affinity).
+    Static,
+    // Workers claim chunks of a fixed number of elements (TeamPool pushes
+    // one pool task per chunk instead).
+    FixedChunk,
+    // Workers claim 1 / (2n) of the remaining elements, but at least chunk.
+    Guided,
+    // Like Guided, but measured in bitLengthCost instead of elements.
+    CostAware,
+};
+
+struct Schedule {
+    SchedulePolicy policy = SchedulePolicy::Static;
+    // Chunk size of FixedChunk, minimal chunk size of Guided and CostAware.
+    size_t chunk = 4;
+};
+
+// Part of the team name, empty for the default Static policy.
+inline std::string scheduleName(const Schedule &schedule) {
+    switch (schedule.policy) {
+        case SchedulePolicy::FixedChunk:
+            return "Chunked";
+        case SchedulePolicy::Guided:
+            return "Guided";
+        case SchedulePolicy::CostAware:
+            return "CostAware";
+        case SchedulePolicy::Static:
+        default:
+            return "";
+    }
+}
+
+// Hands out chunks of a contest to the workers of a team from a shared
+// atomic counter of the next unclaimed element (dynamic policies only).
+class ChunkScheduler {
+public:
+    ChunkScheduler(const ContestInput &input, uint32_t workersArg, Schedule scheduleArg):
+        size(input.size()), workers(workersArg), schedule(scheduleArg), next(0) {
+        assert(schedule.policy != SchedulePolicy::Static && schedule.chunk > 0);
+        if (schedule.policy == SchedulePolicy::CostAware)
+            prefix = costPrefixSums(input);
+    }
+
+    // Claims the next chunk [begin, end), returns false once all are taken.
+    bool claim(size_t &begin, size_t &end) {
+        if (schedule.policy == SchedulePolicy::FixedChunk) {
+            begin = next.fetch_add(schedule.chunk, std::memory_order_relaxed);
+            end = std::min(begin + schedule.chunk, size);
+            return begin < size;
+        }
+
+        begin = next.load(std::memory_order_relaxed);
+        do {
+            if (begin >= size)
+                return false;
+            end = chunkEnd(begin);
+        } while (!next.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+        return true;
+    }
+
+private:
+    size_t chunkEnd(size_t begin) const {
+        size_t minEnd = std::min(begin + schedule.chunk, size);
+        if (schedule.policy == SchedulePolicy::Guided)
+            return std::max(minEnd, begin + (size - begin) / (2 * workers));
+
+        uint64_t target = prefix[begin] + (prefix[size] - prefix[begin]) / (2 * workers);
+        size_t end = std::lower_bound(prefix.begin() + begin, prefix.end(), target) - prefix.begin();
+        return std::max(minEnd, end);
+    }
+
+    const size_t size;
+    const uint32_t workers;
+    const Schedule schedule;
+    std::vector<uint64_t> prefix;
+    std::atomic<size_t> next;
+};
+
+#endif // SCHEDULE_HPP
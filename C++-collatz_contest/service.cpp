@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "contest.hpp"
+#include "limbformat.hpp"
+#include "teamfactory.hpp"
+
+// Long-running contest service: keeps one team alive with its pool,
+// pre-forked workers and shared results, and runs the contests sent to it,
+// so start-up and warm-up are paid once instead of per contest.
+//
+// Usage: service <team> <workers> [--share] [--max-request <bytes>] [--socket <path>]
+//   team is an inner team name, e.g. TeamPoolGuided (see teamfactory.hpp).
+//   --share runs the X variant of the team.
+//   --max-request caps the size of a request, 64 MiB by default.
+//   Without --socket contests come on stdin and results go to stdout. With
+//   it the service listens on a Unix-domain socket at path and serves the
+//   connections one after another (a team runs one contest at a time).
+//   SIGTERM or SIGINT stops the service cleanly: no more requests are read,
+//   the ones already read are answered, the socket is removed and the team
+//   (with its worker processes) is shut down.
+//
+// Framing, all integers in native byte order:
+//   request:  uint64_t bytes, then a buffer of serializeInputs (limbformat.hpp)
+//             of that many bytes, a multiple of 8
+//   response: uint64_t count, then count uint64_t results
+// Requests may be pipelined: a reader thread takes in and decodes the next
+// contests while the current one runs, and responses come in request
+// order. A malformed request, or one too big for the cap or for memory,
+// gets the count BAD_REQUEST and ends the stream, and so does a contest the
+// team fails on (e.g. a worker process died). An empty one gets count 0.
+
+static const uint64_t BAD_REQUEST = UINT64_MAX;
+static const uint64_t DEFAULT_MAX_REQUEST_BYTES = 64ull << 20;
+// The request buffer grows as the body arrives, so a header alone can't
+// make the service allocate the whole declared size.
+static const size_t READ_CHUNK_BYTES = 1 << 20;
+// Decoded requests waiting for the team.
+static const size_t PIPELINE_DEPTH = 4;
+
+struct Request {
+    ContestInput input;
+    bool bad = false;
+};
+
+// Self-pipe of SIGTERM and SIGINT: the handler writes to it, and it stays
+// readable from then on.
+static int stopPipe[2] = {-1, -1};
+
+static void onStopSignal(int) {
+    int savedErrno = errno;
+    ssize_t ignored = write(stopPipe[1], "", 1);
+    (void) ignored;
+    errno = savedErrno;
+}
+
+static bool installStopHandlers() {
+    if (pipe2(stopPipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        return false;
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGTERM, &action, nullptr) == 0 && sigaction(SIGINT, &action, nullptr) == 0;
+}
+
+// Waits until fd has something to read (or an error to report), false if
+// the service is asked to stop first.
+static bool waitReadable(int fd) {
+    pollfd fds[2] = {{fd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            return true;
+        }
+        if (fds[1].revents != 0)
+            return false;
+        if (fds[0].revents != 0)
+            return true;
+    }
+}
+
+// false on end of file, an error or a stop request before all bytes came.
+static bool readFull(int fd, void *buf, size_t bytes) {
+    char *p = static_cast<char*>(buf);
+    while (bytes > 0) {
+        if (!waitReadable(fd))
+            return false;
+        ssize_t n = read(fd, p, bytes);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const void *buf, size_t bytes) {
+    const char *p = static_cast<const char*>(buf);
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+// false at the end of the stream. A malformed request comes back with bad
+// set, and ends the stream too.
+static bool readRequest(int fd, uint64_t maxBytes, Request &request) {
+    uint64_t bytes;
+    if (!readFull(fd, &bytes, sizeof(bytes)))
+        return false;
+    if (bytes % 8 != 0 || bytes > maxBytes) {
+        request.bad = true;
+        return true;
+    }
+
+    try {
+        std::vector<uint64_t> buffer;
+        while (buffer.size() * 8 < bytes) {
+            size_t have = buffer.size();
+            buffer.resize(std::min<uint64_t>(bytes / 8, std::max(2 * have, READ_CHUNK_BYTES / 8)));
+            if (!readFull(fd, buffer.data() + have, (buffer.size() - have) * 8))
+                return false;
+        }
+        if (!validSerializedInputs(buffer.data(), bytes)) {
+            request.bad = true;
+            return true;
+        }
+
+        SerializedInputs inputs(buffer.data());
+        request.input.reserve(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+            request.input.push_back(inputs[i]);
+    }
+    catch (const std::bad_alloc &) {
+        request.input = ContestInput{};
+        request.bad = true;
+    }
+    return true;
+}
+
+static bool writeResponse(int fd, uint64_t count, const uint64_t *results) {
+    return writeFull(fd, &count, sizeof(count)) && writeFull(fd, results, count * sizeof(uint64_t));
+}
+
+// Serves requests from in until its end. After a failed write the
+// remaining requests are still read, but dropped. false if the team failed
+// on a contest: reading stops then (at once for a socket, otherwise when
+// the next request or the end comes).
+static bool serveStream(Team &team, uint64_t maxBytes, int in, int out) {
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<Request> ready;
+    bool finished = false;
+    // Set when the team failed, the reader quits.
+    bool stopped = false;
+
+    std::thread reader([&]() {
+        while (true) {
+            Request request;
+            bool more = readRequest(in, maxBytes, request);
+            bool last = !more || request.bad;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&]() { return ready.size() < PIPELINE_DEPTH || stopped; });
+                if (stopped)
+                    return;
+                if (more)
+                    ready.push_back(std::move(request));
+                finished = last;
+            }
+            cv.notify_all();
+            if (last)
+                return;
+        }
+    });
+
+    bool broken = false;
+    bool failed = false;
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&]() { return !ready.empty() || finished; });
+            if (ready.empty())
+                break;
+            request = std::move(ready.front());
+            ready.pop_front();
+        }
+        cv.notify_all();
+        if (broken)
+            continue;
+
+        if (request.bad) {
+            broken = !writeResponse(out, BAD_REQUEST, nullptr);
+            continue;
+        }
+        // Not every team takes an empty contest.
+        if (request.input.empty()) {
+            broken = !writeResponse(out, 0, nullptr);
+            continue;
+        }
+        ContestResult result;
+        try {
+            result = team.runContest(request.input);
+        }
+        catch (const std::exception &e) {
+            std::cerr << team.getTeamName() << " failed: " << e.what() << std::endl;
+            writeResponse(out, BAD_REQUEST, nullptr);
+            failed = true;
+            break;
+        }
+        broken = !writeResponse(out, result.size(), result.data());
+    }
+
+    if (failed) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            stopped = true;
+        }
+        cv.notify_all();
+        // Wakes a reader blocked in read(), fails with ENOTSOCK otherwise.
+        shutdown(in, SHUT_RD);
+    }
+    reader.join();
+    return !failed;
+}
+
+static int serveSocket(Team &team, uint64_t maxBytes, const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << path << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        std::cerr << "socket - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(listener, 16) == -1) {
+        std::cerr << "bind - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+        close(listener);
+        return 1;
+    }
+
+    int status = 0;
+    while (waitReadable(listener)) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            std::cerr << "accept - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+            status = 1;
+            break;
+        }
+        // A failed contest ends only its connection, the next one may still
+        // succeed (unless the team stays broken, as a ProcessPool does).
+        serveStream(team, maxBytes, connection, connection);
+        close(connection);
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    return status;
+}
+
+static void usage(const char *name) {
+    std::cerr << "usage: " << name << " <team> <workers> [--share] [--max-request <bytes>] [--socket <path>]\nteams:";
+    for (auto &maker : teamMakers())
+        std::cerr << " " << maker.first;
+    std::cerr << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string teamName = argv[1];
+    uint32_t workers = strtoul(argv[2], NULL, 10);
+    bool share = false;
+    uint64_t maxBytes = DEFAULT_MAX_REQUEST_BYTES;
+    std::string socketPath;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--share") {
+            share = true;
+        }
+        else if (arg == "--max-request" && i + 1 < argc) {
+            maxBytes = strtoull(argv[++i], NULL, 10);
+        }
+        else if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (workers == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::shared_ptr<Team> team = makeTeam(teamName, workers, share);
+    if (!team) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // A client going away shows up as a failed write.
+    signal(SIGPIPE, SIG_IGN);
+    if (!installStopHandlers()) {
+        std::cerr << "signals - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if (!socketPath.empty())
+        return serveSocket(*team, maxBytes, socketPath);
+
+    // Responses get stdout to themselves: the timer reports (and any other
+    // output) go to stderr instead.
+    int out = dup(STDOUT_FILENO);
+    if (out == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+        std::cerr << "dup - errno(" << errno << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    bool served = serveStream(*team, maxBytes, STDIN_FILENO, out);
+    close(out);
+    return served ? 0 : 1;
+}
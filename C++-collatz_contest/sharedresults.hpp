@@ -1,31 +1,167 @@
 #ifndef SHAREDRESULTS_HPP
 #define SHAREDRESULTS_HPP
 
-#include <vector>
-#include <map>
-#include <mutex>
-#include <shared_mutex>
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <utility>
 
+#include "lib/infint/InfInt.h"
+#include "mappedarray.hpp"
+#include "resultcache.hpp"
+
+// Fixed-size lock-free cache from uint64_t (other than 0 and 1) to its result.
+//
+// A writer claims a slot with a CAS of its key from 0 and then stores the
+// value; a reader that finds the key but still a 0 value treats it as a
+// miss (every cached result is at least 1). If all slots of the probe window
+// are taken by other keys, the result is not stored.
+class NativeResultMap {
+public:
+    static const size_t MAX_PROBES = 16;
+
+    explicit NativeResultMap(size_t capacity): mask(capacity - 1), slots(capacity) {
+        assert(capacity >= MAX_PROBES && (capacity & mask) == 0);
+    }
+
+    bool find(uint64_t key, uint64_t &value) const {
+        size_t hash = mix(key);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            const Slot &slot = slots[(hash + probe) & mask];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == key) {
+                value = slot.value.load(std::memory_order_acquire);
+                return value != 0;
+            }
+            if (current == 0)
+                return false;
+        }
+        return false;
+    }
+
+    void insert(uint64_t key, uint64_t value) {
+        assert(key > 1 && value > 0);
+        size_t hash = mix(key);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            Slot &slot = slots[(hash + probe) & mask];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == 0 && slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+                current = key;
+            if (current == key) {
+                slot.value.store(value, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> value;
+    };
+
+    static size_t mix(uint64_t hash) {
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    const size_t mask;
+    MappedArray<Slot> slots;
+};
+
+// Which values of a trajectory the X teams write back to SharedResults:
+// those reached after a multiple of stride steps, and only below bound.
+struct MemoPolicy {
+    uint64_t stride = 1;
+    uint64_t bound = UINT64_MAX;
+};
+
+// Bounds of the cache of whole contest inputs.
+struct CacheLimits {
+    size_t maxEntries = 1 << 18;
+    size_t maxBytes = 64 << 20;
+    EvictionKind eviction = EvictionKind::Clock;
+};
+
+// Results of all n < limit in a directly indexed array, 0 meaning unknown.
+// The array is mapped lazily, so untouched parts cost no memory.
+class DenseResultArray {
+public:
+    explicit DenseResultArray(uint64_t limitArg): limit(limitArg), results(limitArg) {}
+
+    bool contains(uint64_t key) const { return key < limit; }
+
+    uint32_t load(uint64_t key) const {
+        return results[key].load(std::memory_order_relaxed);
+    }
+
+    void store(uint64_t key, uint64_t value) {
+        if (value <= UINT32_MAX)
+            results[key].store((uint32_t) value, std::memory_order_relaxed);
+    }
+
+private:
+    const uint64_t limit;
+    MappedArray<std::atomic<uint32_t>> results;
+};
+
 class SharedResults {
 public:
-    SharedResults() {}
+    static const size_t NATIVE_CAPACITY = 1 << 17;
+    static const uint64_t DEFAULT_DENSE_LIMIT = 1 << 22;
+
+    // Results of intermediate values below denseLimit go to a dense array,
+    // the other ones to a hash table. Inputs go to a cache bounded by limits.
+    explicit SharedResults(MemoPolicy policyArg = MemoPolicy{}, uint64_t denseLimit = DEFAULT_DENSE_LIMIT,
+                           CacheLimits limits = CacheLimits{}):
+        policy(policyArg), computed(limits.maxEntries, limits.maxBytes, makeEvictionPolicy(limits.eviction)),
+        computedDense(denseLimit), computedNative(NATIVE_CAPACITY) {
+        assert(policy.stride > 0);
+    }
 
     std::pair<bool, uint64_t> tryRead(const InfInt &in) {
-        std::shared_lock<std::shared_mutex> sl(m);
-        if (computed.count(in) > 0)
-            return {true, computed[in]};
+        uint64_t out;
+        if (computed.find(in, out))
+            return {true, out};
         return {false, 0};
     }
 
     void assignComputed(const InfInt &in, uint64_t out) {
-        std::unique_lock<std::shared_mutex> ul(m);
-        computed[in] = out;
+        computed.insert(in, out);
+    }
+
+    // Results of intermediate values of trajectories.
+    std::pair<bool, uint64_t> tryRead(uint64_t in) {
+        uint64_t out;
+        if (computedDense.contains(in)) {
+            out = computedDense.load(in);
+            return {out != 0, out};
+        }
+        if (computedNative.find(in, out))
+            return {true, out};
+        return {false, 0};
     }
 
+    void assignComputed(uint64_t in, uint64_t out) {
+        if (in <= 1)
+            return;
+        if (computedDense.contains(in))
+            computedDense.store(in, out);
+        else
+            computedNative.insert(in, out);
+    }
+
+    const MemoPolicy &getMemoPolicy() const { return policy; }
+
+    CacheStats getCacheStats() const { return computed.getStats(); }
+
 private:
-    std::shared_mutex m;
-    std::map<InfInt, uint64_t> computed;
+    const MemoPolicy policy;
+    InfIntResultCache computed;
+    DenseResultArray computedDense;
+    NativeResultMap computedNative;
 };
 
-#endif // SHAREDRESULTS_HPP
\ No newline at end of file
+#endif // SHAREDRESULTS_HPP
@@ -0,0 +1,238 @@
+#ifndef SHMRESULTS_HPP
+#define SHMRESULTS_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+#include "lib/infint/InfInt.h"
+#include "sharedresults.hpp"
+
+// SharedResults for teams of processes: everything lives in one anonymous
+// MAP_SHARED region, so the children forked after its creation read and
+// write the same results. Having no name, it can't outlive its processes.
+//
+// The region holds only offsets, never pointers, and is synchronised only
+// with lock-free atomics, which work across processes on shared memory.
+// It has a fixed size: when a probe window or the key arena is full, the
+// result is simply not stored.
+//
+// Layout: header, slots for InfInt keys, slots for uint64_t keys, dense
+// array of small results, arena of serialised InfInt keys. A serialised
+// key is its hash, its limb count and its limbs (base 10^9). A slot for
+// InfInt keys is claimed by a CAS of the key offset from 0; as in
+// NativeResultMap, the value is stored afterwards and 0 reads as a miss.
+class ShmSharedResults {
+public:
+    static const size_t MAX_PROBES = 16;
+    static const size_t DEFAULT_KEY_SLOTS = 1 << 14;
+    static const size_t DEFAULT_ARENA_BYTES = 4 << 20;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "atomics in shared memory have to be address-free");
+
+    explicit ShmSharedResults(MemoPolicy policy = MemoPolicy{},
+                              uint64_t denseLimit = SharedResults::DEFAULT_DENSE_LIMIT,
+                              size_t keySlots = DEFAULT_KEY_SLOTS,
+                              size_t nativeSlots = SharedResults::NATIVE_CAPACITY,
+                              size_t arenaBytes = DEFAULT_ARENA_BYTES):
+        header(nullptr), bytes(0) {
+        assert(policy.stride > 0);
+        assert(keySlots >= MAX_PROBES && (keySlots & (keySlots - 1)) == 0);
+        assert(nativeSlots >= MAX_PROBES && (nativeSlots & (nativeSlots - 1)) == 0);
+
+        Header layout;
+        layout.policy = policy;
+        layout.keySlots = keySlots;
+        layout.nativeSlots = nativeSlots;
+        layout.denseLimit = denseLimit;
+        layout.arenaBytes = align(arenaBytes);
+
+        // The new region reads as zeros, which is an empty cache.
+        bytes = regionBytes(layout);
+        void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+        header = new (mapped) Header(layout);
+        locate();
+    }
+
+    ShmSharedResults(const ShmSharedResults&) = delete;
+    ShmSharedResults& operator=(const ShmSharedResults&) = delete;
+
+    ~ShmSharedResults() { munmap(header, bytes); }
+
+    std::pair<bool, uint64_t> tryRead(const InfInt &in) {
+        if (in < zero())
+            return {false, 0};
+        uint64_t hash = mix(in.hash());
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            const KeySlot &slot = keySlots[(hash + probe) & (header->keySlots - 1)];
+            uint64_t offset = slot.key.load(std::memory_order_acquire);
+            if (offset == 0)
+                return {false, 0};
+            if (matches(offset, hash, in)) {
+                uint64_t out = slot.value.load(std::memory_order_acquire);
+                return {out != 0, out};
+            }
+        }
+        return {false, 0};
+    }
+
+    void assignComputed(const InfInt &in, uint64_t out) {
+        if (in < zero() || out == 0)
+            return;
+        uint64_t hash = mix(in.hash());
+        uint64_t stored = 0;
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            KeySlot &slot = keySlots[(hash + probe) & (header->keySlots - 1)];
+            uint64_t offset = slot.key.load(std::memory_order_acquire);
+            if (offset == 0) {
+                // Serialise the key only once a free slot shows up, and keep
+                // it for the next one if another process takes this slot.
+                if (stored == 0 && (stored = storeKey(hash, in)) == 0)
+                    return;
+                if (slot.key.compare_exchange_strong(offset, stored, std::memory_order_acq_rel))
+                    offset = stored;
+            }
+            if (offset == stored || matches(offset, hash, in)) {
+                slot.value.store(out, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // Results of intermediate values of trajectories.
+    std::pair<bool, uint64_t> tryRead(uint64_t in) {
+        if (in < header->denseLimit) {
+            uint32_t out = dense[in].load(std::memory_order_relaxed);
+            return {out != 0, out};
+        }
+        uint64_t hash = mix(in);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            const NativeSlot &slot = nativeSlots[(hash + probe) & (header->nativeSlots - 1)];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == in) {
+                uint64_t out = slot.value.load(std::memory_order_acquire);
+                return {out != 0, out};
+            }
+            if (current == 0)
+                break;
+        }
+        return {false, 0};
+    }
+
+    void assignComputed(uint64_t in, uint64_t out) {
+        if (in <= 1)
+            return;
+        if (in < header->denseLimit) {
+            if (out <= UINT32_MAX)
+                dense[in].store((uint32_t) out, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t hash = mix(in);
+        for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+            NativeSlot &slot = nativeSlots[(hash + probe) & (header->nativeSlots - 1)];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == 0 && slot.key.compare_exchange_strong(current, in, std::memory_order_acq_rel))
+                current = in;
+            if (current == in) {
+                slot.value.store(out, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    const MemoPolicy &getMemoPolicy() const { return header->policy; }
+
+private:
+    struct Header {
+        MemoPolicy policy;
+        uint64_t keySlots;
+        uint64_t nativeSlots;
+        uint64_t denseLimit;
+        uint64_t arenaBytes;
+        // Bytes of the arena handed out so far, may run past arenaBytes.
+        std::atomic<uint64_t> arenaUsed{0};
+
+        Header() {}
+        Header(const Header &l): policy(l.policy), keySlots(l.keySlots), nativeSlots(l.nativeSlots),
+                                 denseLimit(l.denseLimit), arenaBytes(l.arenaBytes), arenaUsed(0) {}
+    };
+
+    struct KeySlot {
+        // Offset of the serialised key from the region start, 0 if free.
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> value;
+    };
+
+    struct NativeSlot {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> value;
+    };
+
+    struct KeyRecord {
+        uint64_t hash;
+        uint64_t limbCount;
+        ELEM_TYPE limbs[];
+    };
+
+    static size_t align(size_t n) { return (n + 63) & ~(size_t) 63; }
+
+    static size_t keySlotsOffset() { return align(sizeof(Header)); }
+    static size_t nativeSlotsOffset(const Header &h) { return keySlotsOffset() + align(h.keySlots * sizeof(KeySlot)); }
+    static size_t denseOffset(const Header &h) { return nativeSlotsOffset(h) + align(h.nativeSlots * sizeof(NativeSlot)); }
+    static size_t arenaOffset(const Header &h) { return denseOffset(h) + align(h.denseLimit * sizeof(uint32_t)); }
+    static size_t regionBytes(const Header &h) { return arenaOffset(h) + h.arenaBytes; }
+
+    void locate() {
+        char *base = reinterpret_cast<char*>(header);
+        keySlots = reinterpret_cast<KeySlot*>(base + keySlotsOffset());
+        nativeSlots = reinterpret_cast<NativeSlot*>(base + nativeSlotsOffset(*header));
+        dense = reinterpret_cast<std::atomic<uint32_t>*>(base + denseOffset(*header));
+    }
+
+    // Serialises key into the arena, returns its offset or 0 if it is full.
+    uint64_t storeKey(uint64_t hash, const InfInt &key) {
+        size_t recordBytes = align(sizeof(KeyRecord) + key.limbCount() * sizeof(ELEM_TYPE));
+        uint64_t used = header->arenaUsed.fetch_add(recordBytes, std::memory_order_relaxed);
+        if (used + recordBytes > header->arenaBytes)
+            return 0;
+        uint64_t offset = arenaOffset(*header) + used;
+        KeyRecord *record = reinterpret_cast<KeyRecord*>(reinterpret_cast<char*>(header) + offset);
+        record->hash = hash;
+        record->limbCount = key.limbCount();
+        std::memcpy(record->limbs, key.limbData(), key.limbCount() * sizeof(ELEM_TYPE));
+        return offset;
+    }
+
+    bool matches(uint64_t offset, uint64_t hash, const InfInt &key) const {
+        const KeyRecord *record = reinterpret_cast<const KeyRecord*>(reinterpret_cast<const char*>(header) + offset);
+        return record->hash == hash && record->limbCount == key.limbCount() &&
+               std::memcmp(record->limbs, key.limbData(), key.limbCount() * sizeof(ELEM_TYPE)) == 0;
+    }
+
+    static const InfInt &zero() {
+        static const InfInt value = 0;
+        return value;
+    }
+
+    // Finalizer of splitmix64, spreads the hashes over all the bits.
+    static uint64_t mix(uint64_t hash) {
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    Header *header;
+    size_t bytes;
+    KeySlot *keySlots;
+    NativeSlot *nativeSlots;
+    std::atomic<uint32_t> *dense;
+};
+
+#endif // SHMRESULTS_HPP
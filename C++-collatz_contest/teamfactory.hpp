@@ -0,0 +1,71 @@
+#ifndef TEAMFACTORY_HPP
+#define TEAMFACTORY_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "teams.hpp"
+
+typedef std::function<std::shared_ptr<Team>(uint32_t workers, bool share)> TeamMaker;
+
+// Every kind of team by the inner name it reports (getInnerName), without
+// affinities, so tools can pick teams by name.
+inline std::vector<std::pair<std::string, TeamMaker>> teamMakers() {
+    std::vector<std::pair<std::string, TeamMaker>> makers;
+    makers.emplace_back("TeamSolo", [](uint32_t workers, bool) {
+        return std::shared_ptr<Team>(new TeamSolo{workers});
+    });
+    makers.emplace_back("TeamNewThreads", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamNewThreads{workers, share});
+    });
+    for (SchedulePolicy policy : {SchedulePolicy::Static, SchedulePolicy::FixedChunk,
+                                  SchedulePolicy::Guided, SchedulePolicy::CostAware}) {
+        Schedule schedule;
+        schedule.policy = policy;
+        makers.emplace_back("TeamConstThreads" + scheduleName(schedule), [schedule](uint32_t workers, bool share) {
+            return std::shared_ptr<Team>(new TeamConstThreads{workers, share, schedule});
+        });
+        makers.emplace_back("TeamPool" + scheduleName(schedule), [schedule](uint32_t workers, bool share) {
+            return std::shared_ptr<Team>(new TeamPool{workers, share, schedule});
+        });
+    }
+    makers.emplace_back("TeamWorkStealing", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamWorkStealing{workers, share});
+    });
+    makers.emplace_back("TeamCoroutine", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamCoroutine{workers, share});
+    });
+    makers.emplace_back("TeamNewProcesses", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamNewProcesses{workers, share});
+    });
+    makers.emplace_back("TeamConstProcesses", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamConstProcesses{workers, share});
+    });
+    makers.emplace_back("TeamConstProcessesLpt", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamConstProcesses{workers, share, Partitioning::Lpt});
+    });
+    makers.emplace_back("TeamExecProcesses", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamExecProcesses{workers, share});
+    });
+    makers.emplace_back("TeamProcessPool", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamProcessPool{workers, share});
+    });
+    makers.emplace_back("TeamAsync", [](uint32_t workers, bool share) {
+        return std::shared_ptr<Team>(new TeamAsync{workers, share});
+    });
+    return makers;
+}
+
+// nullptr for an unknown name.
+inline std::shared_ptr<Team> makeTeam(const std::string &innerName, uint32_t workers, bool share) {
+    for (auto &maker : teamMakers()) {
+        if (maker.first == innerName)
+            return maker.second(workers, share);
+    }
+    return nullptr;
+}
+
+#endif // TEAMFACTORY_HPP
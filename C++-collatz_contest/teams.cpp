@@ -1,17 +1,28 @@
 #include <utility>
 #include <deque>
 #include <future>
+#include <stdexcept>
 
 #include <algorithm>
 #include "teams.hpp"
 #include "contest.hpp"
 #include "collatz.hpp"
+#include "collatzbatch.hpp"
+#include "collatzcoroutine.hpp"
+#include "collatzmemo.hpp"
+#include "completionqueue.hpp"
+#include "costmodel.hpp"
+#include "futex.hpp"
+#include "mappedarray.hpp"
+#include "rangedeque.hpp"
 #include <unistd.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <cstring>
 #include <sys/mman.h>
 #include <sys/stat.h>        /* For mode constants */
 #include <fcntl.h>           /* For O_* constants */
+#include <climits>
 
 
 static uint64_t computeValue(const InfInt &in, const std::shared_ptr<SharedResults> &shared) {
@@ -20,7 +31,7 @@ static uint64_t computeValue(const InfInt &in, const std::shared_ptr<SharedResul
         auto res = shared->tryRead(in);
         val = res.second;
         if (!res.first) {
-            val = calcCollatz(in);
+            val = calcCollatzShared(in, *shared);
             shared->assignComputed(in, val);
         }
     }
@@ -31,6 +42,94 @@ static uint64_t computeValue(const InfInt &in, const std::shared_ptr<SharedResul
     return val;
 }
 
+// Where workers leave results: the result array and, when the contest is
+// streamed, the queue of finished elements.
+struct ResultSink {
+    uint64_t *results;
+    CompletionQueue *completed;
+
+    void put(size_t i, uint64_t value) const {
+        results[i] = value;
+        if (completed != nullptr)
+            completed->push(i);
+    }
+
+    // Reports results[begin, end), written there directly.
+    void finished(size_t begin, size_t end) const {
+        if (completed == nullptr)
+            return;
+        for (size_t i = begin; i < end; ++i)
+            completed->push(i);
+    }
+};
+
+// out gets the results of input[begin, end) from the batch kernel, reported
+// in blocks of TeamConstProcesses::STREAM_BLOCK when streamed. input is
+// anything calcCollatzBatchLimbs reads.
+template <typename Inputs>
+static void batchTask(const Inputs &input, ResultSink out, size_t begin_id, size_t end_id) {
+    size_t block = out.completed != nullptr ? TeamConstProcesses::STREAM_BLOCK
+                                            : std::max(end_id - begin_id, (size_t) 1);
+    for (size_t begin = begin_id; begin < end_id; begin += block) {
+        size_t end = std::min(begin + block, end_id);
+        calcCollatzBatchLimbs(input, begin, end, out.results + begin);
+        out.finished(begin, end);
+    }
+}
+
+// Runs callback on the next count elements to finish.
+static void deliverCompleted(CompletionQueue &completed, const uint64_t *results, size_t count,
+                             const ResultCallback &callback) {
+    for (size_t k = 0; k < count; ++k) {
+        size_t i = completed.pop();
+        callback(i, results[i]);
+    }
+}
+
+// Whether all children exited, with failed set once one of them exited
+// with an error or was killed. Doesn't reap them.
+static bool childrenExited(const std::vector<pid_t> &children, bool &failed) {
+    bool exited = true;
+    for (pid_t child : children) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PID, child, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+            failed = true;
+            return true;
+        }
+        if (info.si_pid == 0)
+            exited = false;
+        else if (info.si_code != CLD_EXITED || info.si_status != 0)
+            failed = true;
+    }
+    return exited;
+}
+
+// deliverCompleted for elements computed by the child processes children.
+// A child that dies would leave its elements missing for good, so the wait
+// wakes up now and then to look at them. false if one of them failed.
+static bool deliverCompleted(CompletionQueue &completed, const uint64_t *results, size_t count,
+                             const ResultCallback &callback, const std::vector<pid_t> &children) {
+    const timespec liveCheck = {0, 100 * 1000 * 1000};
+    for (size_t k = 0; k < count; ++k) {
+        size_t i;
+        while (!completed.popFor(i, liveCheck)) {
+            bool failed = false;
+            bool exited = childrenExited(children, failed);
+            if (failed)
+                return false;
+            // Children push all their elements before they exit.
+            if (exited) {
+                if (!completed.popFor(i, liveCheck))
+                    return false;
+                break;
+            }
+        }
+        callback(i, results[i]);
+    }
+    return true;
+}
+
 static void newThreadsFun(std::mutex &m, std::condition_variable_any &cv,
                           ContestResult &result, const InfInt &in, size_t pos,
                           uint32_t &workingThreads, const std::shared_ptr<SharedResults> &shared) {
@@ -78,45 +177,375 @@ ContestResult TeamNewThreads::runContestImpl(const ContestInput &contestInput) {
 }
 
 static void threadFunEqualSize(uint32_t id, uint32_t thread_count, const ContestInput &input,
-                               ContestResult &res, const std::shared_ptr<SharedResults> &shared) {
-    ContestResult r(input.size());
+                               ResultSink out, const std::shared_ptr<SharedResults> &shared) {
     size_t i = id;
     while (i < input.size()) {
-        res[i] = computeValue(input[i], shared);
+        out.put(i, computeValue(input[i], shared));
         i += thread_count;
     }
 }
 
-ContestResult TeamConstThreads::runContestImpl(const ContestInput &contestInput) {
+// Worker id of thread_count takes the id-th contiguous slice.
+static void threadFunSlice(uint32_t id, uint32_t thread_count, const ContestInput &input,
+                           ResultSink out, const std::shared_ptr<SharedResults> &shared) {
+    size_t begin = input.size() * id / thread_count, end = input.size() * (id + 1) / thread_count;
+    for (size_t i = begin; i < end; ++i)
+        out.put(i, computeValue(input[i], shared));
+}
+
+// threadFunSlice without shared results, through the batch kernel.
+static void threadFunBatch(uint32_t id, uint32_t thread_count, const ContestInput &input, ResultSink out) {
+    batchTask(InfIntArrayLimbs{input.data()}, out, input.size() * id / thread_count,
+              input.size() * (id + 1) / thread_count);
+}
+
+static void threadFunScheduled(ChunkScheduler &scheduler, const ContestInput &input,
+                               ResultSink out, const std::shared_ptr<SharedResults> &shared) {
+    size_t begin, end;
+    while (scheduler.claim(begin, end)) {
+        for (size_t i = begin; i < end; ++i)
+            out.put(i, computeValue(input[i], shared));
+    }
+}
+
+static void pinCurrentThread(int cpu) {
+    if (cpu >= 0)
+        pinThread(pthread_self(), cpu);
+}
+
+ContestResult TeamConstThreads::runContestImpl(const ContestInput &contestInput, const ResultCallback &callback) {
     ContestResult r(contestInput.size());
     uint32_t thread_count = this->getSize();
+    std::shared_ptr<SharedResults> shared = this->getSharedResults();
+
+    std::unique_ptr<ChunkScheduler> scheduler;
+    if (this->schedule.policy != SchedulePolicy::Static)
+        scheduler.reset(new ChunkScheduler(contestInput, thread_count, this->schedule));
+
+    // Untouched until the workers write their results, see TeamConstThreads.
+    MappedArray<uint64_t> firstTouch(this->hasAffinity() ? contestInput.size() : 0);
+    uint64_t *res = this->hasAffinity() ? firstTouch.get() : r.data();
+
+    std::unique_ptr<CompletionQueue> completed;
+    if (callback)
+        completed.reset(new CompletionQueue(contestInput.size()));
+    ResultSink out{res, completed.get()};
 
     std::vector<std::thread> threads;
 
-    for (size_t i = 0; i < thread_count; ++i) {
-        threads.push_back(this->createThread(threadFunEqualSize, i, thread_count, std::ref(contestInput),
-                                             std::ref(r), this->getSharedResults()));
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        threads.push_back(this->createThread([&, i](int cpu) {
+            pinCurrentThread(cpu);
+            if (scheduler)
+                threadFunScheduled(*scheduler, contestInput, out, shared);
+            else if (!shared)
+                threadFunBatch(i, thread_count, contestInput, out);
+            else if (this->hasAffinity())
+                threadFunSlice(i, thread_count, contestInput, out, shared);
+            else
+                threadFunEqualSize(i, thread_count, contestInput, out, shared);
+        }, this->getWorkerCpu(i)));
     }
 
+    if (completed)
+        deliverCompleted(*completed, res, contestInput.size(), callback);
+
     for (size_t i = 0; i < thread_count; ++i) {
         threads[i].join();
     }
 
+    if (this->hasAffinity())
+        std::copy(res, res + contestInput.size(), r.begin());
+    return r;
+}
+
+struct WorkStealingState {
+    // Failed stealing rounds before a thief goes to sleep.
+    static const uint32_t STEAL_SPINS = 64;
+
+    WorkStealingState(uint32_t workers, size_t inputSize):
+        deques(new RangeDeque[workers]), remaining(inputSize), idle(0), sleeping(0), wakeSeq(0) {}
+
+    std::unique_ptr<RangeDeque[]> deques;
+    // Elements not computed yet, the workers quit at 0.
+    std::atomic<size_t> remaining;
+    // Workers looking for something to steal.
+    std::atomic<uint32_t> idle;
+    // Thieves that may sleep on wakeSeq, bumped (and woken) when a range is
+    // pushed for them or remaining reaches 0.
+    std::atomic<uint32_t> sleeping;
+    std::atomic<uint32_t> wakeSeq;
+
+    void wake(int count) {
+        wakeSeq.fetch_add(1, std::memory_order_release);
+        futexWake(wakeSeq, count);
+    }
+};
+
+static bool stealRange(uint32_t id, uint32_t thread_count, WorkStealingState &state, IndexRange &range) {
+    for (uint32_t i = 1; i < thread_count; ++i) {
+        if (state.deques[(id + i) % thread_count].steal(range))
+            return true;
+    }
+    return false;
+}
+
+static void workStealingFun(uint32_t id, uint32_t thread_count, WorkStealingState &state, const ContestInput &input,
+                            ContestResult &res, const std::shared_ptr<SharedResults> &shared, WorkerStats &stats) {
+    RangeDeque &own = state.deques[id];
+    double busy = 0.0;
+    uint64_t steals = 0;
+    IndexRange range;
+
+    while (state.remaining.load(std::memory_order_acquire) > 0) {
+        if (!own.pop(range)) {
+            state.idle.fetch_add(1, std::memory_order_relaxed);
+            bool stolen = false;
+            uint32_t failed = 0;
+            while (!stolen && state.remaining.load(std::memory_order_acquire) > 0) {
+                stolen = stealRange(id, thread_count, state, range);
+                if (stolen)
+                    break;
+                if (++failed < WorkStealingState::STEAL_SPINS) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                // Announced before the last try, so a range pushed after it
+                // sees the sleeper and bumps wakeSeq (the fence in
+                // RangeDeque::steal pairs with the one after the push).
+                state.sleeping.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seq = state.wakeSeq.load(std::memory_order_acquire);
+                if (state.remaining.load(std::memory_order_acquire) > 0 &&
+                    !(stolen = stealRange(id, thread_count, state, range)))
+                    futexWait(state.wakeSeq, seq);
+                state.sleeping.fetch_sub(1, std::memory_order_relaxed);
+                failed = 0;
+            }
+            state.idle.fetch_sub(1, std::memory_order_relaxed);
+            if (!stolen)
+                break;
+            ++steals;
+        }
+
+        auto start = rtimers::cxx11::HiResClock::now();
+        uint32_t done = 0;
+        while (range.begin < range.end) {
+            if (range.size() > 1 && state.idle.load(std::memory_order_relaxed) > 0) {
+                uint32_t mid = range.begin + range.size() / 2;
+                if (own.push({mid, range.end})) {
+                    range.end = mid;
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (state.sleeping.load(std::memory_order_relaxed) > 0)
+                        state.wake(1);
+                }
+            }
+            res[range.begin] = computeValue(input[range.begin], shared);
+            ++range.begin;
+            ++done;
+        }
+        busy += rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+        if (state.remaining.fetch_sub(done, std::memory_order_acq_rel) == done)
+            state.wake(INT_MAX);
+    }
+
+    stats.addWorker(busy, steals);
+}
+
+ContestResult TeamWorkStealing::runContestImpl(const ContestInput &contestInput) {
+    ContestResult r(contestInput.size());
+    uint32_t thread_count = this->getSize();
+    assert(contestInput.size() <= UINT32_MAX);
+
+    WorkStealingState state(thread_count, contestInput.size());
+    uint32_t begin = 0;
+    for (size_t i = 0; i < thread_count; ++i) {
+        uint32_t my_size = contestInput.size() / thread_count + (i < contestInput.size() % thread_count ? 1 : 0);
+        if (my_size > 0)
+            state.deques[i].push({begin, begin + my_size});
+        begin += my_size;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.push_back(this->createThread(workStealingFun, i, thread_count, std::ref(state), std::ref(contestInput),
+                                             std::ref(r), this->getSharedResults(), std::ref(this->stats)));
+    }
+
+    for (std::thread &t : threads)
+        t.join();
+
     return r;
 }
 
-ContestResult TeamPool::runContest(const ContestInput &contestInput) {
+struct CoroutineJob {
+    size_t index;
+    // Estimated work left, in bits of the current value.
+    size_t bits;
+    CollatzCoroutine coroutine;
+};
+
+// Orders a std::push_heap/pop_heap heap with the least work left on top.
+static bool moreWorkLeft(const CoroutineJob &a, const CoroutineJob &b) {
+    return a.bits > b.bits;
+}
+
+static void coroutineFun(std::atomic<size_t> &next, uint64_t quantum, const ContestInput &input,
+                         ResultSink out, const std::shared_ptr<SharedResults> &shared,
+                         rtimers::cxx11::HiResClock::Instant contestStart, std::atomic<double> &latencySum,
+                         WorkerStats &stats) {
+    std::vector<CoroutineJob> jobs;
+    jobs.reserve(TeamCoroutine::WINDOW);
+    double latency = 0.0;
+    auto start = rtimers::cxx11::HiResClock::now();
+
+    auto finish = [&](size_t i, uint64_t value) {
+        out.put(i, value);
+        latency += rtimers::cxx11::HiResClock::interval(contestStart, rtimers::cxx11::HiResClock::now());
+    };
+
+    while (true) {
+        while (jobs.size() < TeamCoroutine::WINDOW) {
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= input.size())
+                break;
+            if (shared) {
+                auto cached = shared->tryRead(input[i]);
+                if (cached.first) {
+                    finish(i, cached.second);
+                    continue;
+                }
+            }
+            jobs.push_back({i, estimatedBits(input[i]), collatzCoroutine(input[i], quantum)});
+            std::push_heap(jobs.begin(), jobs.end(), moreWorkLeft);
+        }
+        if (jobs.empty())
+            break;
+
+        std::pop_heap(jobs.begin(), jobs.end(), moreWorkLeft);
+        CoroutineJob &job = jobs.back();
+        job.coroutine.resume();
+        if (job.coroutine.done()) {
+            if (shared)
+                shared->assignComputed(input[job.index], job.coroutine.result());
+            finish(job.index, job.coroutine.result());
+            jobs.pop_back();
+        }
+        else {
+            job.bits = job.coroutine.bits();
+            std::push_heap(jobs.begin(), jobs.end(), moreWorkLeft);
+        }
+    }
+
+    stats.addWorker(rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now()), 0);
+    latencySum.fetch_add(latency, std::memory_order_relaxed);
+}
+
+ContestResult TeamCoroutine::runContestImpl(const ContestInput &contestInput, const ResultCallback &callback) {
     ContestResult r(contestInput.size());
     uint32_t thread_count = this->getSize();
+    std::atomic<size_t> next(0);
+
+    std::unique_ptr<CompletionQueue> completed;
+    if (callback)
+        completed.reset(new CompletionQueue(contestInput.size()));
+    ResultSink out{r.data(), completed.get()};
 
-    std::vector<std::future<void>> futures(thread_count);
+    std::atomic<double> latencySum(0.0);
+    auto contestStart = rtimers::cxx11::HiResClock::now();
 
+    std::vector<std::thread> threads;
     for (size_t i = 0; i < thread_count; ++i) {
-        futures[i] = this->pool.push(threadFunEqualSize, i, thread_count, std::ref(contestInput),
-                                     std::ref(r), this->getSharedResults());
+        threads.push_back(this->createThread(coroutineFun, std::ref(next), this->quantum, std::ref(contestInput),
+                                             out, this->getSharedResults(), contestStart,
+                                             std::ref(latencySum), std::ref(this->stats)));
+    }
+
+    if (completed)
+        deliverCompleted(*completed, r.data(), contestInput.size(), callback);
+
+    for (std::thread &t : threads)
+        t.join();
+
+    if (!contestInput.empty())
+        this->stats.addMeanLatency(latencySum.load() / contestInput.size());
+    return r;
+}
+
+// Each task pins the worker running it and then waits for all the others,
+// so every worker of the pool takes exactly one of them.
+void TeamPool::pinWorkers() {
+    uint32_t thread_count = this->getSize();
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t started = 0;
+
+    std::vector<std::future<void>> futures;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        futures.push_back(this->pool.push([&]() {
+            std::unique_lock<std::mutex> lock(m);
+            pinCurrentThread(this->getWorkerCpu(started));
+            if (++started == thread_count)
+                cv.notify_all();
+            else
+                cv.wait(lock, [&]() { return started == thread_count; });
+        }));
     }
 
     cxxpool::get(futures.begin(), futures.end());
+}
+
+ContestResult TeamPool::runContestStreaming(const ContestInput &contestInput, const ResultCallback &callback) {
+    ContestResult r(contestInput.size());
+    uint32_t thread_count = this->getSize();
+    std::shared_ptr<SharedResults> shared = this->getSharedResults();
+
+    std::unique_ptr<CompletionQueue> completed;
+    if (callback)
+        completed.reset(new CompletionQueue(contestInput.size()));
+
+    // Untouched until the workers write their results, see TeamConstThreads.
+    MappedArray<uint64_t> firstTouch(this->hasAffinity() ? contestInput.size() : 0);
+    uint64_t *res = this->hasAffinity() ? firstTouch.get() : r.data();
+    ResultSink out{res, completed.get()};
+
+    // Fixed chunks are scheduled by the pool itself: one task per chunk,
+    // all pushed under a single lock.
+    if (this->schedule.policy == SchedulePolicy::FixedChunk) {
+        std::future<void> done = this->pool.parallel_for((size_t) 0, contestInput.size(), this->schedule.chunk,
+                                                          [&](size_t i) {
+            out.put(i, computeValue(contestInput[i], shared));
+        });
+        if (completed)
+            deliverCompleted(*completed, res, contestInput.size(), callback);
+        done.get();
+    }
+    else {
+        std::vector<std::future<void>> futures(thread_count);
+
+        std::unique_ptr<ChunkScheduler> scheduler;
+        if (this->schedule.policy != SchedulePolicy::Static)
+            scheduler.reset(new ChunkScheduler(contestInput, thread_count, this->schedule));
+
+        for (uint32_t i = 0; i < thread_count; ++i) {
+            if (scheduler)
+                futures[i] = this->pool.push(threadFunScheduled, std::ref(*scheduler), std::ref(contestInput),
+                                             out, shared);
+            else if (!shared)
+                futures[i] = this->pool.push(threadFunBatch, i, thread_count, std::ref(contestInput), out);
+            else if (this->hasAffinity())
+                futures[i] = this->pool.push(threadFunSlice, i, thread_count, std::ref(contestInput), out, shared);
+            else
+                futures[i] = this->pool.push(threadFunEqualSize, i, thread_count, std::ref(contestInput), out, shared);
+        }
+
+        if (completed)
+            deliverCompleted(*completed, res, contestInput.size(), callback);
+
+        cxxpool::get(futures.begin(), futures.end());
+    }
+
+    if (this->hasAffinity())
+        std::copy(res, res + contestInput.size(), r.begin());
     return r;
 }
 
@@ -131,13 +560,35 @@ static void print_error(const char *s) {
     exit(1);
 }
 
-void processTask(const ContestInput &input, uint64_t *output, size_t begin_id, size_t my_size) {
-    for (size_t i = 0; i < my_size; ++i)
-        output[i + begin_id] = calcCollatz(input[i + begin_id]);
+static uint64_t computeShmValue(const InfInt &in, ShmSharedResults &shared) {
+    auto res = shared.tryRead(in);
+    uint64_t value = res.second;
+    if (!res.first) {
+        value = calcCollatzShared(in, shared);
+        shared.assignComputed(in, value);
+    }
+    return value;
+}
+
+// Streamed results are reported in blocks of TeamConstProcesses::STREAM_BLOCK
+// when computed by the batch kernel, one by one otherwise.
+void processTask(const ContestInput &input, ResultSink out, size_t begin_id, size_t my_size,
+                 ShmSharedResults *shared) {
+    size_t end_id = begin_id + my_size;
+    if (shared == nullptr) {
+        batchTask(InfIntArrayLimbs{input.data()}, out, begin_id, end_id);
+        return;
+    }
+
+    for (size_t i = begin_id; i < end_id; ++i)
+        out.put(i, computeShmValue(input[i], *shared));
 }
 
 ContestResult TeamNewProcesses::runContest(const ContestInput &contestInput) {
     ContestResult r(contestInput.size());
+    // mmap can't map the results of no inputs.
+    if (contestInput.empty())
+        return r;
     uint32_t p_count = this->getSize();
 
     pid_t pid;
@@ -159,7 +610,7 @@ ContestResult TeamNewProcesses::runContest(const ContestInput &contestInput) {
             print_error("NewProcesses fork");
         }
         else if (pid == 0) {
-            processTask(contestInput, mapped_output, i, 1);
+            processTask(contestInput, ResultSink{mapped_output, nullptr}, i, 1, this->getShmResults());
             if (munmap(mapped_output, result_bytes) == -1)
                 print_error("NewProcesses munmap child");
 
@@ -192,46 +643,106 @@ ContestResult TeamNewProcesses::runContest(const ContestInput &contestInput) {
     return r;
 }
 
-ContestResult TeamConstProcesses::runContest(ContestInput const &contestInput) {
+// processTask for the elements of input at indices, in blocks of
+// STREAM_BLOCK when streaming.
+static void processIndices(const ContestInput &input, ResultSink out, const std::vector<size_t> &indices,
+                           ShmSharedResults *shared) {
+    size_t block = out.completed != nullptr ? TeamConstProcesses::STREAM_BLOCK : std::max(indices.size(), (size_t) 1);
+    ContestInput part;
+    ContestResult partOutput;
+    for (size_t begin = 0; begin < indices.size(); begin += block) {
+        size_t end = std::min(begin + block, indices.size());
+        part.clear();
+        for (size_t j = begin; j < end; ++j)
+            part.push_back(input[indices[j]]);
+
+        partOutput.resize(part.size());
+        processTask(part, ResultSink{partOutput.data(), nullptr}, 0, part.size(), shared);
+        for (size_t j = begin; j < end; ++j)
+            out.put(indices[j], partOutput[j - begin]);
+    }
+}
+
+ContestResult TeamConstProcesses::runContestStreaming(ContestInput const &contestInput, const ResultCallback &callback) {
     ContestResult r(contestInput.size());
     uint32_t p_count = this->getSize();
 
     pid_t pid;
 
+    std::vector<std::vector<size_t>> parts;
+    if (this->partitioning == Partitioning::Lpt)
+        parts = partitionLpt(elementCosts(contestInput), p_count);
+
+    // Results, followed by the time each child took.
     size_t result_bytes = contestInput.size() * sizeof(uint64_t);
+    size_t mapped_bytes = result_bytes + p_count * sizeof(double);
     uint64_t *mapped_output;
+    double *mapped_seconds;
     int fd_mem_out = -1;
     int flags = MAP_SHARED | MAP_ANONYMOUS, prot = PROT_READ | PROT_WRITE;
 
-    mapped_output = (uint64_t*) mmap(NULL, result_bytes, prot, flags, fd_mem_out, 0);
+    mapped_output = (uint64_t*) mmap(NULL, mapped_bytes, prot, flags, fd_mem_out, 0);
     if (mapped_output == MAP_FAILED)
         print_error("ConstProcesses mmap");
+    mapped_seconds = (double*) (mapped_output + contestInput.size());
+
+    // Created before the fork, so the children push to the parent's queue.
+    std::unique_ptr<CompletionQueue> completed;
+    if (callback)
+        completed.reset(new CompletionQueue(contestInput.size()));
+    ResultSink out{mapped_output, completed.get()};
+    std::vector<pid_t> children;
 
     size_t begin = 0;
     for (size_t i = 0; i < p_count; ++i) {
 
-        size_t my_size = contestInput.size() / p_count + (i < contestInput.size() % p_count ? 1 : 0);
+        size_t my_size = parts.empty() ? contestInput.size() / p_count + (i < contestInput.size() % p_count ? 1 : 0)
+                                       : parts[i].size();
 
         pid = fork();
         if (pid == -1) {
             print_error("ConstProcesses fork");
         }
         else if (pid == 0) {
-            processTask(contestInput, mapped_output, begin, my_size);
-
-            if (munmap(mapped_output, result_bytes) == -1)
+            if (this->hasAffinity())
+                pinProcess(this->getWorkerCpu(i));
+            auto start = rtimers::cxx11::HiResClock::now();
+            if (parts.empty())
+                processTask(contestInput, out, begin, my_size, this->getShmResults());
+            else
+                processIndices(contestInput, out, parts[i], this->getShmResults());
+            mapped_seconds[i] = rtimers::cxx11::HiResClock::interval(start, rtimers::cxx11::HiResClock::now());
+
+            if (munmap(mapped_output, mapped_bytes) == -1)
                 print_error("ConstProcesses munmap child");
 
             exit(0);
         }
         else {
+            children.push_back(pid);
             begin += my_size;
         }
     }
 
-    for (size_t i = 0; i < p_count; ++i) {
-        if (wait(nullptr) == -1)
-            print_error("ConstProcesses wait");
+    bool failed = completed && !deliverCompleted(*completed, mapped_output, contestInput.size(), callback, children);
+    if (failed) {
+        for (pid_t child : children)
+            kill(child, SIGKILL);
+    }
+
+    // Only the children of this contest: waiting for any child could reap
+    // another team's workers.
+    for (pid_t child : children) {
+        int status;
+        if (waitpid(child, &status, 0) == -1)
+            print_error("ConstProcesses waitpid");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+    // A failed child leaves its results unwritten.
+    if (failed) {
+        munmap(mapped_output, mapped_bytes);
+        throw std::runtime_error("ConstProcesses: a child died");
     }
 
     assert(begin == contestInput.size());
@@ -239,17 +750,141 @@ ContestResult TeamConstProcesses::runContest(ContestInput const &contestInput) {
     for (size_t i = 0; i < contestInput.size(); ++i)
         r[i] = mapped_output[i];
 
-    if (munmap(mapped_output, result_bytes) == -1)
+    double makespan = 0.0;
+    for (size_t i = 0; i < p_count; ++i) {
+        this->stats.addWorker(mapped_seconds[i], 0);
+        makespan = std::max(makespan, mapped_seconds[i]);
+    }
+    this->stats.addMakespan(makespan);
+
+    if (munmap(mapped_output, mapped_bytes) == -1)
         print_error("ConstProcesses munmap parent");
 
     return r;
 }
 
-// interval [l, r)
-static void asyncFun(size_t l, size_t r, size_t rec_depth, const ContestInput &input,
+// new_process in the directory of the running program.
+static std::string execWorkerPath() {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length == -1)
+        print_error("ExecProcesses readlink");
+    std::string exe(path, length);
+    return exe.substr(0, exe.rfind('/') + 1) + "new_process";
+}
+
+// Shared memory of the given size, known only by the returned descriptor.
+static int unlinkedShm(size_t bytes) {
+    static std::atomic<uint32_t> created{0};
+    std::string name = "/collatz_exec_" + std::to_string(getpid()) + "_" + std::to_string(created.fetch_add(1));
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        print_error("ExecProcesses shm_open");
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, bytes) == -1)
+        print_error("ExecProcesses ftruncate");
+    return fd;
+}
+
+ContestResult TeamExecProcesses::runContest(const ContestInput &contestInput) {
+    ContestResult r(contestInput.size());
+    // mmap can't map the results of no inputs.
+    if (contestInput.empty())
+        return r;
+    uint32_t p_count = this->getSize();
+
+    size_t input_bytes = serializedInputsBytes(contestInput.data(), contestInput.size());
+    size_t result_bytes = contestInput.size() * sizeof(uint64_t);
+    int fd_mem_in = unlinkedShm(input_bytes);
+    int fd_mem_out = unlinkedShm(result_bytes);
+
+    void *mapped_input = mmap(NULL, input_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_mem_in, 0);
+    if (mapped_input == MAP_FAILED)
+        print_error("ExecProcesses mmap in");
+    serializeInputs(contestInput.data(), contestInput.size(), mapped_input);
+    if (munmap(mapped_input, input_bytes) == -1)
+        print_error("ExecProcesses munmap in");
+
+    std::string worker = execWorkerPath();
+    std::string fd_in_str = std::to_string(fd_mem_in), fd_out_str = std::to_string(fd_mem_out);
+    std::vector<pid_t> children;
+
+    size_t begin = 0;
+    for (size_t i = 0; i < p_count; ++i) {
+        size_t my_size = contestInput.size() / p_count + (i < contestInput.size() % p_count ? 1 : 0);
+        if (my_size == 0)
+            continue;
+        std::string begin_str = std::to_string(begin), size_str = std::to_string(my_size);
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            print_error("ExecProcesses fork");
+        }
+        else if (pid == 0) {
+            // shm_open descriptors are closed on exec by default.
+            if (fcntl(fd_mem_in, F_SETFD, 0) == -1 || fcntl(fd_mem_out, F_SETFD, 0) == -1)
+                print_error("ExecProcesses fcntl");
+            execl(worker.c_str(), "new_process", begin_str.c_str(), size_str.c_str(),
+                  fd_in_str.c_str(), fd_out_str.c_str(), (char*) NULL);
+            print_error("ExecProcesses execl");
+        }
+        else {
+            children.push_back(pid);
+            begin += my_size;
+        }
+    }
+    assert(begin == contestInput.size());
+
+    bool failed = false;
+    for (pid_t child : children) {
+        int status;
+        if (waitpid(child, &status, 0) == -1)
+            print_error("ExecProcesses waitpid");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+
+    if (!failed) {
+        uint64_t *mapped_output = (uint64_t*) mmap(NULL, result_bytes, PROT_READ, MAP_SHARED, fd_mem_out, 0);
+        if (mapped_output == MAP_FAILED)
+            print_error("ExecProcesses mmap out");
+        std::copy(mapped_output, mapped_output + contestInput.size(), r.begin());
+        munmap(mapped_output, result_bytes);
+    }
+    close(fd_mem_in);
+    close(fd_mem_out);
+
+    if (failed)
+        throw std::runtime_error("ExecProcesses: a child failed");
+    return r;
+}
+
+TeamProcessPool::TeamProcessPool(uint32_t sizeArg, bool shareResults): TeamProcesses(sizeArg, shareResults) {
+    ShmSharedResults *shared = this->getShmResults();
+    // Reads the inputs straight from the pool's arena, an InfInt is made
+    // only for an element of the shared results.
+    this->pool.reset(new ProcessPool(sizeArg, [shared](const SerializedInputs &inputs, size_t begin, size_t end,
+                                                       uint64_t *out, CompletionQueue *completed) {
+        ResultSink sink{out, completed};
+        if (shared == nullptr) {
+            batchTask(inputs, sink, begin, end);
+            return;
+        }
+        for (size_t i = begin; i < end; ++i)
+            sink.put(i, computeShmValue(inputs[i], *shared));
+    }));
+}
+
+ContestResult TeamProcessPool::runContestStreaming(const ContestInput &contestInput, const ResultCallback &callback) {
+    ContestResult r(contestInput.size());
+    this->pool->run(contestInput.data(), contestInput.size(), r.data(), callback);
+    return r;
+}
+
+// interval [l, r), split in halves depth more times.
+static void asyncFun(ForkJoinExecutor &executor, size_t l, size_t r, uint32_t depth, const ContestInput &input,
                      ContestResult &result, const std::shared_ptr<SharedResults> &shared) {
-    // 32 threads are enough.
-    if (r - l == 1 || rec_depth == 5) {
+    if (r - l == 1 || depth == 0) {
         for (size_t i = l; i < r; ++i) {
             result[i] = computeValue(input[i], shared);
         }
@@ -257,15 +892,30 @@ static void asyncFun(size_t l, size_t r, size_t rec_depth, const ContestInput &i
     }
 
     size_t m = (l + r) / 2;
-    std::future<void> fut = std::async(std::launch::async, asyncFun, m, r, rec_depth + 1,
-                                       std::ref(input), std::ref(result), shared);
-    asyncFun(l, m, rec_depth + 1, input, result, shared);
-    fut.get();
+    ForkJoinExecutor::Task upper([&, m, r, depth]() {
+        asyncFun(executor, m, r, depth - 1, input, result, shared);
+    });
+    executor.fork(upper);
+    asyncFun(executor, l, m, depth - 1, input, result, shared);
+    executor.join(upper);
+}
+
+// About 4 leaves per thread (the workers and the caller) for balance, but
+// no more leaves than elements.
+static uint32_t asyncDepth(size_t inputSize, uint32_t workers) {
+    size_t leaves = std::min(inputSize, (size_t) 4 * (workers + 1));
+    uint32_t depth = 0;
+    while (((size_t) 1 << depth) < leaves)
+        ++depth;
+    return depth;
 }
 
 ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
     ContestResult r(contestInput.size());
-    asyncFun(0, contestInput.size(), 0, contestInput, r, this->getSharedResults());
+    if (contestInput.empty())
+        return r;
+    uint32_t depth = asyncDepth(contestInput.size(), this->executor.getWorkers());
+    asyncFun(this->executor, 0, contestInput.size(), depth, contestInput, r, this->getSharedResults());
     return r;
 }
 
@@ -280,9 +930,9 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //    pid_t pid;
 //    size_t w_count = 0;
 //
-//    size_t input_bytes = contestInput.size() * MAX_INFINT_LEN;
+//    size_t input_bytes = serializedInputsBytes(contestInput.data(), contestInput.size());
 //    size_t result_bytes = contestInput.size() * sizeof(uint64_t);
-//    char (*mapped_input)[MAX_INFINT_LEN];
+//    void *mapped_input;
 //    uint64_t *mapped_output;
 //    int fd_mem_in = -1, fd_mem_out = -1;
 //    int flags, prot;
@@ -310,21 +960,17 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //    prot = PROT_READ | PROT_WRITE;
 //    flags = MAP_SHARED;
 //
-//    mapped_input = (char(*)[MAX_INFINT_LEN]) mmap(NULL, input_bytes, prot, flags, fd_mem_in, 0);
+//    mapped_input = mmap(NULL, input_bytes, prot, flags, fd_mem_in, 0);
 //    if (mapped_input == MAP_FAILED) {
 //        printf("essa0 - errno(%d): %s\n", errno, std::strerror(errno));
 //    }
 //
-//    for (size_t i = 0; i < contestInput.size(); ++i) {
-//        strcpy(mapped_input[i], contestInput[i].toString().c_str());
-//    }
+//    serializeInputs(contestInput.data(), contestInput.size(), mapped_input);
 //
 //    for (size_t i = 0; i < contestInput.size(); ++i) {
 //
 //        char begin_id[10];
-//        char is[15];
 //        sprintf(begin_id, "%lu", i);
-//        sprintf(is, "%lu", contestInput.size());
 //
 //        pid = fork();
 //        if (pid == -1) {
@@ -344,7 +990,7 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //                printf("close 2 child - errno(%d): %s\n", errno, std::strerror(errno));
 //                exit(1);
 //            }
-//            execl("./new_process", "new_process", begin_id, "1", is, NULL);
+//            execl("./new_process", "new_process", begin_id, "1", NULL);
 //            std::cerr << "error in execl\n";
 //            exit(1);
 //        }
@@ -401,9 +1047,9 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //    pid_t pid;
 //    size_t w_count = 0;
 //
-//    size_t input_bytes = contestInput.size() * MAX_INFINT_LEN;
+//    size_t input_bytes = serializedInputsBytes(contestInput.data(), contestInput.size());
 //    size_t result_bytes = contestInput.size() * sizeof(uint64_t);
-//    char (*mapped_input)[MAX_INFINT_LEN];
+//    void *mapped_input;
 //    uint64_t *mapped_output;
 //    int fd_mem_in = -1, fd_mem_out = -1;
 //    int flags, prot;
@@ -431,15 +1077,12 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //    prot = PROT_READ | PROT_WRITE;
 //    flags = MAP_SHARED;
 //
-//    mapped_input = (char(*)[MAX_INFINT_LEN]) mmap(NULL, input_bytes, prot, flags, fd_mem_in, 0);
+//    mapped_input = mmap(NULL, input_bytes, prot, flags, fd_mem_in, 0);
 //    if (mapped_input == MAP_FAILED) {
 //        printf("essa0 - errno(%d): %s\n", errno, std::strerror(errno));
 //    }
 //
-//    for (size_t i = 0; i < contestInput.size(); ++i) {
-//        strcpy(mapped_input[i], contestInput[i].toString().c_str());
-//        //std::cout << mapped_input[i] << std::endl;
-//    }
+//    serializeInputs(contestInput.data(), contestInput.size(), mapped_input);
 //
 //    size_t begin = 0;
 //    for (size_t i = 0; i < p_count; ++i) {
@@ -449,12 +1092,10 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //        char fd_out_str[10];
 //        char begin_id[10];
 //        char amount[15];
-//        char is[15];
 //        sprintf(fd_in_str, "%d", fd_mem_in);
 //        sprintf(fd_out_str, "%d", fd_mem_out);
 //        sprintf(amount, "%lu", input_size);
 //        sprintf(begin_id, "%lu", begin);
-//        sprintf(is, "%lu", contestInput.size());
 //
 //        pid = fork();
 //        if (pid == -1) {
@@ -465,7 +1106,7 @@ ContestResult TeamAsync::runContest(const ContestInput &contestInput) {
 //            munmap(mapped_input, input_bytes);
 //            close(fd_mem_in);
 //            close(fd_mem_out);
-//            execl("./new_process", "new_process", begin_id, amount, is, NULL);
+//            execl("./new_process", "new_process", begin_id, amount, NULL);
 //            std::cerr << "error in execl\n";
 //            exit(1);
 //        }
@@ -7,16 +7,27 @@
 #include "lib/rtimers/cxx11.hpp"
 #include "lib/pool/cxxpool.h"
 
+#include "affinity.hpp"
 #include "contest.hpp"
 #include "collatz.hpp"
+#include "collatzbatch.hpp"
+#include "forkjoin.hpp"
 #include "sharedresults.hpp"
+#include "processpool.hpp"
+#include "schedule.hpp"
+#include "shmresults.hpp"
+#include "workerstats.hpp"
 
 class Team {
 public:
-    Team(uint32_t sizeArg, bool shareResults): size(sizeArg), sharedResults() {
+    // Teams of processes keep shared results in their own shared memory,
+    // so they pass heapResults = false.
+    Team(uint32_t sizeArg, bool shareResultsArg, bool heapResults = true, Affinity affinityArg = Affinity{}):
+        sharedResults(), size(sizeArg), shareResults(shareResultsArg), affinity(affinityArg),
+        cpus(workerCpus(affinityArg, sizeArg)) {
         assert(this->size > 0);
 
-        if (shareResults) {
+        if (shareResults && heapResults) {
             this->sharedResults.reset(new SharedResults{});
         }
     }
@@ -29,13 +40,40 @@ public:
     }
 
     virtual ContestResult runContest(ContestInput const & contest) = 0;
-    std::string getXname() { return this->getSharedResults() ? "X" : ""; }
-    virtual std::string getTeamName() { return this->getInnerName() + this->getXname() + "<" + std::to_string(this->size) + ">"; }
+    // runContest that also passes every result to callback as soon as it is
+    // known, one at a time on the calling thread, in the order the elements
+    // finish. The callback must not throw. Teams that only know the results
+    // at the end pass them all in index order after runContest. These are
+    // TeamSolo and TeamAsync, whose calling thread computes too, TeamNewThreads,
+    // TeamWorkStealing and TeamNewProcesses, kept as they were for
+    // comparison, and TeamExecProcesses, whose exec'd workers can't reach
+    // a CompletionQueue in anonymous shared memory.
+    virtual ContestResult runContestStreaming(ContestInput const & contest, const ResultCallback &callback) {
+        ContestResult result = this->runContest(contest);
+        for (size_t i = 0; i < result.size(); ++i)
+            callback(i, result[i]);
+        return result;
+    }
+    bool getShareResults() const { return this->shareResults; }
+    std::string getXname() { return this->shareResults ? "X" : ""; }
+    virtual std::string getTeamName() {
+        return this->getInnerName() + affinityName(this->affinity) + this->getXname() + "<" + std::to_string(this->size) + ">";
+    }
     uint32_t getSize() const { return this->size; }
+    // Threads or processes that compute a contest, the size unless the team
+    // sizes itself.
+    virtual uint32_t getWorkerCount() const { return this->size; }
+
+    bool hasAffinity() const { return !this->cpus.empty(); }
+    // CPU worker i is pinned to, -1 without an affinity.
+    int getWorkerCpu(uint32_t i) const { return this->cpus.empty() ? -1 : this->cpus[i]; }
 
 private:
     std::shared_ptr<SharedResults> sharedResults;
     uint32_t size;
+    bool shareResults;
+    const Affinity affinity;
+    const std::vector<int> cpus;
 };
 
 class TeamSolo : public Team {
@@ -45,14 +83,12 @@ public:
     virtual ContestResult runContest(ContestInput const & contestInput) {
         ContestResult result;
         result.resize(contestInput.size());
-        uint64_t idx = 0;
 
         rtimers::cxx11::DefaultTimer soloTimer("CalcCollatzSoloTimer");
 
-        for(InfInt const & singleInput : contestInput) {
+        {
             auto scopedStartStop = soloTimer.scopedStart();
-            result[idx] = calcCollatz(singleInput);
-            ++idx;
+            calcCollatzBatch(contestInput.data(), contestInput.size(), result.data());
         }
         return result;
     }
@@ -62,7 +98,8 @@ public:
 
 class TeamThreads : public Team {
 public:
-    TeamThreads(uint32_t sizeArg, bool shareResults): Team(sizeArg, shareResults), createdThreads(0) {}
+    TeamThreads(uint32_t sizeArg, bool shareResults, Affinity affinity = Affinity{}):
+        Team(sizeArg, shareResults, true, affinity), createdThreads(0) {}
     
     template< class Function, class... Args >
     std::thread createThread(Function&& f, Args&&... args) {
@@ -93,9 +130,81 @@ public:
     virtual std::string getInnerName() { return "TeamNewThreads"; }
 };
 
+// Without shared results the Static schedule gives the workers contiguous
+// slices, computed by the batch kernel (strides would leave it nothing to
+// gather). With an affinity each worker is pinned to its CPU, and the
+// Static schedule gives contiguous slices either way, computed into lazily
+// mapped memory, so the pages of a slice are first touched, and so placed,
+// on the node of the worker that owns it.
 class TeamConstThreads : public TeamThreads {
 public:
-    TeamConstThreads(uint32_t sizeArg, bool shareResults): TeamThreads(sizeArg, shareResults) {}
+    TeamConstThreads(uint32_t sizeArg, bool shareResults, Schedule scheduleArg = Schedule{},
+                     Affinity affinity = Affinity{}):
+        TeamThreads(sizeArg, shareResults, affinity), schedule(scheduleArg) {}
+
+    virtual ContestResult runContest(ContestInput const & contestInput) {
+        return this->runContestStreaming(contestInput, ResultCallback{});
+    }
+
+    // An empty callback streams nothing.
+    virtual ContestResult runContestStreaming(ContestInput const & contestInput, const ResultCallback &callback) {
+        this->resetThreads();
+        ContestResult result = this->runContestImpl(contestInput, callback);
+        assert(this->getSize() == this->getCreatedThreads());
+        return result;
+    }
+
+    virtual ContestResult runContestImpl(ContestInput const & contestInput, const ResultCallback &callback);
+
+    virtual std::string getInnerName() { return "TeamConstThreads" + scheduleName(this->schedule); }
+
+private:
+    const Schedule schedule;
+};
+
+// Every element is a collatzCoroutine suspending every quantum steps. Each
+// worker keeps up to WINDOW of them in progress and always resumes the one
+// with the least estimated work left (shortest remaining work first),
+// taking new elements from a shared counter as others finish. Short
+// elements then don't wait behind long trajectories, which lowers the mean
+// time until an element is done (reported as .latency) for the same work.
+class TeamCoroutine : public TeamThreads {
+public:
+    static const uint64_t DEFAULT_QUANTUM = 1024;
+    static const size_t WINDOW = 16;
+
+    TeamCoroutine(uint32_t sizeArg, bool shareResults, uint64_t quantumArg = DEFAULT_QUANTUM):
+        TeamThreads(sizeArg, shareResults), quantum(quantumArg), stats(this->getTeamName()) {}
+
+    virtual ContestResult runContest(ContestInput const & contestInput) {
+        return this->runContestStreaming(contestInput, ResultCallback{});
+    }
+
+    // An empty callback streams nothing.
+    virtual ContestResult runContestStreaming(ContestInput const & contestInput, const ResultCallback &callback) {
+        this->resetThreads();
+        ContestResult result = this->runContestImpl(contestInput, callback);
+        assert(this->getSize() == this->getCreatedThreads());
+        return result;
+    }
+
+    virtual ContestResult runContestImpl(ContestInput const & contestInput, const ResultCallback &callback);
+
+    virtual std::string getInnerName() { return "TeamCoroutine"; }
+
+private:
+    const uint64_t quantum;
+    WorkerStats stats;
+};
+
+// Each worker starts with a contiguous part of the contest in its own
+// RangeDeque and works through it one element at a time. While some worker
+// is idle, busy workers split their remaining range in half and push the
+// upper half for it to steal, so one long trajectory holds only its worker.
+class TeamWorkStealing : public TeamThreads {
+public:
+    TeamWorkStealing(uint32_t sizeArg, bool shareResults):
+        TeamThreads(sizeArg, shareResults), stats(this->getTeamName()) {}
 
     virtual ContestResult runContest(ContestInput const & contestInput) {
         this->resetThreads();
@@ -106,45 +215,152 @@ public:
 
     virtual ContestResult runContestImpl(ContestInput const & contestInput);
 
-    virtual std::string getInnerName() { return "TeamConstThreads"; }
+    virtual std::string getInnerName() { return "TeamWorkStealing"; }
+
+private:
+    WorkerStats stats;
 };
 
+// Static schedule and affinity as in TeamConstThreads, the pool threads are
+// pinned once.
 class TeamPool : public Team {
 public:
-    TeamPool(uint32_t sizeArg, bool shareResults): Team(sizeArg, shareResults), pool(sizeArg) {}
+    TeamPool(uint32_t sizeArg, bool shareResults, Schedule scheduleArg = Schedule{}, Affinity affinity = Affinity{}):
+        Team(sizeArg, shareResults, true, affinity), pool(sizeArg), schedule(scheduleArg) {
+        if (this->hasAffinity())
+            this->pinWorkers();
+    }
 
-    virtual ContestResult runContest(ContestInput const & contestInput);
+    virtual ContestResult runContest(ContestInput const & contestInput) {
+        return this->runContestStreaming(contestInput, ResultCallback{});
+    }
+
+    // An empty callback streams nothing.
+    virtual ContestResult runContestStreaming(ContestInput const & contestInput, const ResultCallback &callback);
 
-    virtual std::string getInnerName() { return "TeamPool"; }
+    virtual std::string getInnerName() { return "TeamPool" + scheduleName(this->schedule); }
 private:
+    void pinWorkers();
+
     cxxpool::thread_pool pool;
+    const Schedule schedule;
+};
+
+class TeamProcesses : public Team {
+public:
+    TeamProcesses(uint32_t sizeArg, bool shareResults, Affinity affinity = Affinity{}):
+        Team(sizeArg, shareResults, false, affinity) {
+        if (shareResults) {
+            this->shmResults.reset(new ShmSharedResults{});
+        }
+    }
+
+    // Results shared by the children, nullptr if the team doesn't share.
+    ShmSharedResults *getShmResults() { return this->shmResults.get(); }
+
+private:
+    std::unique_ptr<ShmSharedResults> shmResults;
 };
 
-class TeamNewProcesses : public Team {
+class TeamNewProcesses : public TeamProcesses {
 public:
-    TeamNewProcesses(uint32_t sizeArg, bool shareResults): Team(sizeArg, shareResults) {}
+    TeamNewProcesses(uint32_t sizeArg, bool shareResults): TeamProcesses(sizeArg, shareResults) {}
 
     virtual ContestResult runContest(ContestInput const & contestInput);
 
     virtual std::string getInnerName() { return "TeamNewProcesses"; }
 };
 
-class TeamConstProcesses : public Team {
+// How TeamConstProcesses splits a contest between its children.
+enum class Partitioning {
+    // Consecutive parts of equal size.
+    Contiguous,
+    // Parts of equal estimated cost (bitLengthCost), by partitionLpt.
+    Lpt,
+};
+
+// With an affinity each child pins itself before computing. The result
+// pages are not touched by the parent, so a child's part of them is placed
+// on its own node.
+class TeamConstProcesses : public TeamProcesses {
+public:
+    static const size_t STREAM_BLOCK = 64;
+
+    TeamConstProcesses(uint32_t sizeArg, bool shareResults, Partitioning partitioningArg = Partitioning::Contiguous,
+                       Affinity affinity = Affinity{}):
+        TeamProcesses(sizeArg, shareResults, affinity), partitioning(partitioningArg), stats(this->getTeamName()) {}
+
+    virtual ContestResult runContest(ContestInput const & contestInput) {
+        return this->runContestStreaming(contestInput, ResultCallback{});
+    }
+
+    // An empty callback streams nothing. The children report their results
+    // through a CompletionQueue in memory shared with the parent, in blocks
+    // of STREAM_BLOCK without shared results (the batch kernel needs a few
+    // elements to fill its lanes). Throws std::runtime_error when a child
+    // dies or fails, streamed or not.
+    virtual ContestResult runContestStreaming(ContestInput const & contestInput, const ResultCallback &callback);
+
+    virtual std::string getInnerName() {
+        return partitioning == Partitioning::Lpt ? "TeamConstProcessesLpt" : "TeamConstProcesses";
+    }
+
+private:
+    const Partitioning partitioning;
+    WorkerStats stats;
+};
+
+// Children exec new_process (next to the running program) on consecutive
+// parts of the contest. They get it through shm_open memory written by
+// serializeInputs (limbformat.hpp), passed as inherited descriptors: the
+// names are unlinked at once. new_process shares no results, so there is
+// no X variant. Throws std::runtime_error when a child fails.
+class TeamExecProcesses : public TeamProcesses {
 public:
-    TeamConstProcesses(uint32_t sizeArg, bool shareResults): Team(sizeArg, shareResults) {}
+    TeamExecProcesses(uint32_t sizeArg, bool /*shareResults*/): TeamProcesses(sizeArg, false) {} // don't share
 
     virtual ContestResult runContest(ContestInput const & contestInput);
 
-    virtual std::string getInnerName() { return "TeamConstProcesses"; }
+    virtual std::string getInnerName() { return "TeamExecProcesses"; }
+};
+
+// Forks its workers once and runs every contest on them through a ProcessPool.
+class TeamProcessPool : public TeamProcesses {
+public:
+    TeamProcessPool(uint32_t sizeArg, bool shareResults);
+
+    virtual ContestResult runContest(ContestInput const & contestInput) {
+        return this->runContestStreaming(contestInput, ResultCallback{});
+    }
+
+    // An empty callback streams nothing. The workers report their results
+    // through the pool's CompletionQueue, in blocks of
+    // TeamConstProcesses::STREAM_BLOCK without shared results. Throws
+    // std::runtime_error when a worker dies, streamed or not.
+    virtual ContestResult runContestStreaming(ContestInput const & contestInput, const ResultCallback &callback);
+
+    virtual std::string getInnerName() { return "TeamProcessPool"; }
+
+private:
+    std::unique_ptr<ProcessPool> pool;
 };
 
+// Recursive halving as fork-join tasks on an executor with one thread per
+// hardware thread besides the caller, so no threads are created per contest.
 class TeamAsync : public Team {
 public:
-    TeamAsync(uint32_t sizeArg, bool shareResults): Team(1, shareResults) {} // ignore size
+    TeamAsync(uint32_t sizeArg, bool shareResults): Team(1, shareResults), executor(asyncWorkers()) {} // ignore size
 
     virtual ContestResult runContest(ContestInput const & contestInput);
 
     virtual std::string getInnerName() { return "TeamAsync"; }
+    // The executor's threads and the calling one.
+    virtual uint32_t getWorkerCount() const { return this->executor.getWorkers() + 1; }
+
+private:
+    static uint32_t asyncWorkers() { return std::max(std::thread::hardware_concurrency(), 2u) - 1; }
+
+    ForkJoinExecutor executor;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef WORKERSTATS_HPP
+#define WORKERSTATS_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include "lib/rtimers/cxx11.hpp"
+
+// Ranges stolen by the workers of a team, a sample per worker and contest.
+// The rtimers stats print their samples as times, so counts get their own.
+struct StealStats {
+    StealStats(): count(0), total(0) {}
+
+    void addSample(uint64_t steals) {
+        ++count;
+        total += steals;
+    }
+
+    unsigned long count;
+    uint64_t total;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const StealStats& stats) {
+    os << "steals = " << stats.total << " (n=" << stats.count << ")";
+    return os;
+}
+
+// Load balance of a team: the time each worker spent computing in each
+// contest, the makespan of each contest (time of its slowest worker), the
+// mean latency of each contest (time from its start until an element is
+// done, averaged over the elements) and how many ranges were stolen,
+// reported through rtimers next to the team timers when the team is
+// destroyed. A balanced team has busy times close to each other (small
+// std, min close to max).
+class WorkerStats {
+public:
+    explicit WorkerStats(const std::string &nameArg): name(nameArg) {}
+
+    WorkerStats(const WorkerStats&) = delete;
+    WorkerStats& operator=(const WorkerStats&) = delete;
+
+    ~WorkerStats() {
+        if (busy.count == 0)
+            return;
+        rtimers::StderrLogger::report(name + ".busy", busy);
+        if (makespan.count > 0)
+            rtimers::StderrLogger::report(name + ".makespan", makespan);
+        if (latency.count > 0)
+            rtimers::StderrLogger::report(name + ".latency", latency);
+        if (steals.total > 0)
+            rtimers::StderrLogger::report(name + ".steals", steals);
+    }
+
+    void addWorker(double busySeconds, uint64_t workerSteals) {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy.addSample(busySeconds);
+        steals.addSample(workerSteals);
+    }
+
+    void addMakespan(double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        makespan.addSample(seconds);
+    }
+
+    void addMeanLatency(double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        latency.addSample(seconds);
+    }
+
+private:
+    const std::string name;
+    std::mutex mutex;
+    rtimers::VarBoundStats busy;
+    rtimers::VarBoundStats makespan;
+    rtimers::VarBoundStats latency;
+    StealStats steals;
+};
+
+#endif // WORKERSTATS_HPP